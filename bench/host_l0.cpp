@@ -0,0 +1,414 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include <algorithm>
+
+using namespace std;
+
+#define CHECK(a)                                                              \
+	do {                                                                  \
+		auto err = (a);                                               \
+		if (err != 0) {                                               \
+			fprintf(stderr, "FAIL: err=%d @ line=%d (%s)\n", err, \
+				__LINE__, (#a));                              \
+			exit(err);                                            \
+		}                                                             \
+	} while (0)
+#define CHECK2(a, msg)                                                      \
+	do {                                                                \
+		if ((a)) {                                                  \
+			fprintf(stderr, "FAIL: @ line=%d (%s)\n", __LINE__, \
+				(msg));                                     \
+			exit(-1);                                           \
+		}                                                           \
+	} while (0)
+#if !defined(HELLO_KERNEL) || !defined(VADD_KERNEL)
+#error "Error: HELLO_KERNEL and VADD_KERNEL must be defined with location of kernel binaries"
+#endif
+
+/* ints per vector_add thread */
+#define VADD_SZ 16
+/* transfer sweep: MIN_BYTES to the maximum in steps of SIZE_STEP */
+#define MIN_BYTES 4096
+#define SIZE_STEP 4
+/* repetitions of one size move at least SWEEP_BYTES, within [3, iterations] */
+#define SWEEP_BYTES (256 << 20)
+/* widest 2D image */
+#define IMAGE_MAX_WIDTH 16384
+
+typedef chrono::steady_clock timer;
+
+static double usSince(timer::time_point t0)
+{
+	return chrono::duration<double, micro>(timer::now() - t0).count();
+}
+
+static double kernelTimeNs(ze_event_handle_t hEvent, ze_device_properties_t &props)
+{
+	ze_kernel_timestamp_result_t ts;
+	CHECK(zeEventQueryKernelTimestamp(hEvent, &ts));
+
+	uint64_t mask = props.kernelTimestampValidBits >= 64 ?
+				~0ULL :
+				(1ULL << props.kernelTimestampValidBits) - 1;
+	uint64_t cycles = (ts.context.kernelEnd - ts.context.kernelStart) & mask;
+	/* timerResolution is in ns per cycle */
+	return cycles * (double)props.timerResolution;
+}
+
+static vector<unsigned char> readKernel(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == nullptr) {
+		fprintf(stderr, "FAIL: unable to open %s\n", path);
+		exit(-1);
+	}
+	fseek(fp, 0, SEEK_END);
+	vector<unsigned char> code(ftell(fp));
+	rewind(fp);
+	size_t ret = fread(code.data(), 1, code.size(), fp);
+	fclose(fp);
+	CHECK2(ret != code.size(), "Error reading kernel");
+	return code;
+}
+
+static ze_kernel_handle_t createKernel(ze_context_handle_t context, ze_device_handle_t device,
+				       const char *path, const char *name,
+				       ze_module_handle_t *module)
+{
+	vector<unsigned char> code = readKernel(path);
+	ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
+					nullptr,
+					ZE_MODULE_FORMAT_IL_SPIRV,
+					code.size(),
+					code.data(),
+					"-vc-codegen",
+					nullptr };
+	CHECK(zeModuleCreate(context, device, &moduleDesc, module, nullptr));
+	ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0, name };
+	ze_kernel_handle_t kernel;
+	CHECK(zeKernelCreate(*module, &kernelDesc, &kernel));
+	CHECK(zeKernelSetGroupSize(kernel, 1, 1, 1));
+	return kernel;
+}
+
+static double percentile(vector<double> &v, double p)
+{
+	if (v.empty())
+		return 0.0;
+	sort(v.begin(), v.end());
+	return v[min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+static void printLatency(const char *name, vector<double> &us)
+{
+	printf("%-32s p50 %9.2f  p90 %9.2f  p99 %9.2f  max %9.2f us  (%zu runs)\n", name,
+	       percentile(us, 0.50), percentile(us, 0.90), percentile(us, 0.99),
+	       percentile(us, 1.0), us.size());
+}
+
+static void sync(ze_command_list_handle_t list, ze_event_handle_t hEvent)
+{
+	CHECK(zeCommandListAppendBarrier(list, hEvent, 0, nullptr));
+	CHECK(zeEventHostSynchronize(hEvent, numeric_limits<uint64_t>::max()));
+	CHECK(zeEventHostReset(hEvent));
+}
+
+int main(int argc, char *argv[])
+{
+	// usage: main.l0.skl [iterations [max MiB]]
+	int nIterations = 1000;
+	size_t max_bytes = 64 << 20;
+
+	if (argc > 1)
+		nIterations = max(3, atoi(argv[1]));
+	if (argc > 2)
+		max_bytes = max((size_t)MIN_BYTES, (size_t)atoi(argv[2]) << 20);
+
+	// initialize GPU
+	ze_driver_handle_t driver = nullptr;
+	ze_device_handle_t device = nullptr;
+	ze_context_handle_t context = nullptr;
+
+	CHECK(zeInit(ZE_INIT_FLAG_GPU_ONLY));
+
+	// Discover all the driver instances
+	uint32_t driverCount = 0;
+	CHECK(zeDriverGet(&driverCount, nullptr));
+	CHECK2((driverCount == 0), "unable to locate driver(s)");
+
+	ze_driver_handle_t *allDrivers =
+		(ze_driver_handle_t *)malloc(driverCount * sizeof(*allDrivers));
+	CHECK(zeDriverGet(&driverCount, allDrivers));
+
+	// Find a driver instance with a GPU device
+	for (uint32_t i = 0; i < driverCount; ++i) {
+		uint32_t deviceCount = 0;
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, nullptr));
+		if (deviceCount == 0)
+			continue;
+		ze_device_handle_t *allDevices = (ze_device_handle_t *)malloc(
+			deviceCount * sizeof(ze_device_handle_t));
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, allDevices));
+		for (uint32_t d = 0; d < deviceCount; ++d) {
+			ze_device_properties_t device_properties;
+			CHECK(zeDeviceGetProperties(allDevices[d], &device_properties));
+			if (ZE_DEVICE_TYPE_GPU == device_properties.type) {
+				fprintf(stderr, "INFO: GPU device located driver=%d, device=%d\n",
+					i, d);
+				driver = allDrivers[i];
+				device = allDevices[d];
+				break;
+			}
+		}
+		if (nullptr != device)
+			break;
+	}
+	CHECK2((driver == nullptr), "unable to locate driver with GPU device");
+	CHECK2((device == nullptr), "unable to locate GPU device");
+
+	ze_device_properties_t props = { ZE_STRUCTURE_TYPE_DEVICE_PROPERTIES };
+	CHECK(zeDeviceGetProperties(device, &props));
+	printf("%s, %d iterations, transfers up to %zu MiB\n", props.name, nIterations,
+	       max_bytes >> 20);
+
+	ze_context_desc_t contextDesc = { ZE_STRUCTURE_TYPE_CONTEXT_DESC, nullptr, 0 };
+	CHECK(zeContextCreate(driver, &contextDesc, &context));
+
+	/* the same queue settings for the immediate list and the regular queue */
+	ze_command_queue_desc_t queueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
+					      nullptr,
+					      0,
+					      0,
+					      0,
+					      ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+					      ZE_COMMAND_QUEUE_PRIORITY_NORMAL };
+	ze_command_list_handle_t commands;
+	CHECK(zeCommandListCreateImmediate(context, device, &queueDesc, &commands));
+	ze_command_queue_handle_t queue;
+	CHECK(zeCommandQueueCreate(context, device, &queueDesc, &queue));
+
+	ze_module_handle_t hello_module, vadd_module;
+	ze_kernel_handle_t hello =
+		createKernel(context, device, HELLO_KERNEL, "hello_world", &hello_module);
+	ze_kernel_handle_t vadd =
+		createKernel(context, device, VADD_KERNEL, "vector_add", &vadd_module);
+
+	/* hEvent for host syncs, hTsEvent also carries kernel timestamps */
+	ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr, 0, 2 };
+	pool_desc.flags = ZE_EVENT_POOL_FLAG_HOST_VISIBLE | ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP;
+	ze_event_pool_handle_t hPool = nullptr;
+	CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &hPool));
+	ze_event_handle_t hEvent, hTsEvent;
+	ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, 0,
+				 ZE_EVENT_SCOPE_FLAG_HOST, ZE_EVENT_SCOPE_FLAG_HOST };
+	CHECK(zeEventCreate(hPool, &desc, &hEvent));
+	desc.index = 1;
+	CHECK(zeEventCreate(hPool, &desc, &hTsEvent));
+
+	/* both kernels still take the trace surface, nothing is written to it */
+	ze_device_mem_alloc_desc_t deviceDesc = { ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC,
+						  nullptr, 0, 0 };
+	ze_host_mem_alloc_desc_t hostDesc = { ZE_STRUCTURE_TYPE_HOST_MEM_ALLOC_DESC, nullptr, 0 };
+	void *d_trace = nullptr;
+	CHECK(zeMemAllocDevice(context, &deviceDesc, 4096, 64, device, &d_trace));
+	int threadwidth = 1;
+	CHECK(zeKernelSetArgumentValue(hello, 0, sizeof(threadwidth), &threadwidth));
+	CHECK(zeKernelSetArgumentValue(hello, 1, sizeof(d_trace), &d_trace));
+	ze_group_count_t one = { 1, 1, 1 };
+
+	// dispatch: the floor cost of getting one empty kernel through
+	printf("\n-- dispatch --\n");
+	vector<double> wall, device_us, barrier, regular;
+
+	/* warm up, the first launches pay for residency and caches */
+	for (int i = 0; i < 10; i++)
+		CHECK(zeCommandListAppendLaunchKernel(commands, hello, &one, nullptr, 0, nullptr));
+	sync(commands, hEvent);
+
+	for (int i = 0; i < nIterations; i++) {
+		auto t0 = timer::now();
+		CHECK(zeCommandListAppendLaunchKernel(commands, hello, &one, hTsEvent, 0, nullptr));
+		CHECK(zeEventHostSynchronize(hTsEvent, numeric_limits<uint64_t>::max()));
+		wall.push_back(usSince(t0));
+		device_us.push_back(kernelTimeNs(hTsEvent, props) / 1000.0);
+		CHECK(zeEventHostReset(hTsEvent));
+	}
+	printLatency("launch + sync, immediate", wall);
+	printLatency("empty kernel, device time", device_us);
+
+	for (int i = 0; i < nIterations; i++) {
+		auto t0 = timer::now();
+		sync(commands, hEvent);
+		barrier.push_back(usSince(t0));
+	}
+	printLatency("barrier + event sync", barrier);
+
+	/* host side cost of polling a signaled event */
+	CHECK(zeEventHostSignal(hEvent));
+	auto q0 = timer::now();
+	for (int i = 0; i < nIterations; i++)
+		CHECK(zeEventQueryStatus(hEvent));
+	printf("%-32s %9.3f us per call\n", "event query", usSince(q0) / nIterations);
+	CHECK(zeEventHostReset(hEvent));
+
+	/* a regular list is built once and executed again and again */
+	ze_command_list_desc_t listDesc = { ZE_STRUCTURE_TYPE_COMMAND_LIST_DESC, nullptr, 0, 0 };
+	ze_command_list_handle_t single;
+	CHECK(zeCommandListCreate(context, device, &listDesc, &single));
+	CHECK(zeCommandListAppendLaunchKernel(single, hello, &one, nullptr, 0, nullptr));
+	CHECK(zeCommandListClose(single));
+	for (int i = 0; i < nIterations; i++) {
+		auto t0 = timer::now();
+		CHECK(zeCommandQueueExecuteCommandLists(queue, 1, &single, nullptr));
+		CHECK(zeCommandQueueSynchronize(queue, numeric_limits<uint64_t>::max()));
+		regular.push_back(usSince(t0));
+	}
+	printLatency("launch + sync, regular list", regular);
+
+	/* back to back launches with one sync at the end */
+	auto t0 = timer::now();
+	for (int i = 0; i < nIterations; i++)
+		CHECK(zeCommandListAppendLaunchKernel(commands, hello, &one, nullptr, 0, nullptr));
+	sync(commands, hEvent);
+	double immediate_rate = nIterations / usSince(t0) * 1e6;
+
+	ze_command_list_handle_t batch;
+	CHECK(zeCommandListCreate(context, device, &listDesc, &batch));
+	for (int i = 0; i < nIterations; i++)
+		CHECK(zeCommandListAppendLaunchKernel(batch, hello, &one, nullptr, 0, nullptr));
+	CHECK(zeCommandListClose(batch));
+	t0 = timer::now();
+	CHECK(zeCommandQueueExecuteCommandLists(queue, 1, &batch, nullptr));
+	CHECK(zeCommandQueueSynchronize(queue, numeric_limits<uint64_t>::max()));
+	double regular_rate = nIterations / usSince(t0) * 1e6;
+	printf("%-32s %9.0f immediate, %9.0f regular list\n", "launches per second",
+	       immediate_rate, regular_rate);
+
+	// transfers: GB/s over sizes, the median of the repetitions
+	printf("\n-- bandwidth, GB/s --\n");
+	printf("%10s %9s %9s %9s %9s %9s %9s\n", "bytes", "h2d", "d2h", "h2d-pgbl", "img-up",
+	       "img-down", "vadd");
+
+	void *h_buf = nullptr, *d_buf = nullptr, *d_a = nullptr, *d_b = nullptr, *d_c = nullptr;
+	CHECK(zeMemAllocHost(context, &hostDesc, max_bytes, 64, &h_buf));
+	CHECK(zeMemAllocDevice(context, &deviceDesc, max_bytes, 64, device, &d_buf));
+	CHECK(zeMemAllocDevice(context, &deviceDesc, max_bytes, 64, device, &d_a));
+	CHECK(zeMemAllocDevice(context, &deviceDesc, max_bytes, 64, device, &d_b));
+	CHECK(zeMemAllocDevice(context, &deviceDesc, max_bytes, 64, device, &d_c));
+	vector<char> pageable(max_bytes);
+	memset(h_buf, 1, max_bytes);
+	CHECK(zeKernelSetArgumentValue(vadd, 0, sizeof(d_a), &d_a));
+	CHECK(zeKernelSetArgumentValue(vadd, 1, sizeof(d_b), &d_b));
+	CHECK(zeKernelSetArgumentValue(vadd, 2, sizeof(d_c), &d_c));
+	CHECK(zeKernelSetArgumentValue(vadd, 3, sizeof(d_trace), &d_trace));
+
+	for (size_t bytes = MIN_BYTES; bytes <= max_bytes; bytes *= SIZE_STEP) {
+		int reps = max(3, min(nIterations, (int)(SWEEP_BYTES / bytes)));
+
+		/* wall time per operation, including the event sync */
+		auto measure = [&](auto append) {
+			vector<double> us;
+			for (int r = 0; r < reps; r++) {
+				auto r0 = timer::now();
+				append(hEvent);
+				CHECK(zeEventHostSynchronize(hEvent,
+							     numeric_limits<uint64_t>::max()));
+				us.push_back(usSince(r0));
+				CHECK(zeEventHostReset(hEvent));
+			}
+			return bytes / percentile(us, 0.5) / 1e3;
+		};
+
+		double h2d = measure([&](ze_event_handle_t ev) {
+			CHECK(zeCommandListAppendMemoryCopy(commands, d_buf, h_buf, bytes, ev, 0,
+							    nullptr));
+		});
+		double d2h = measure([&](ze_event_handle_t ev) {
+			CHECK(zeCommandListAppendMemoryCopy(commands, h_buf, d_buf, bytes, ev, 0,
+							    nullptr));
+		});
+		double pgbl = measure([&](ze_event_handle_t ev) {
+			CHECK(zeCommandListAppendMemoryCopy(commands, d_buf, pageable.data(), bytes,
+							    ev, 0, nullptr));
+		});
+
+		/* float image of the same size, as wide as allowed */
+		uint32_t width = min<size_t>(bytes / sizeof(float), IMAGE_MAX_WIDTH);
+		uint32_t height = bytes / sizeof(float) / width;
+		ze_image_desc_t imageDesc = { ZE_STRUCTURE_TYPE_IMAGE_DESC,
+					      nullptr,
+					      0,
+					      ZE_IMAGE_TYPE_2D,
+					      { ZE_IMAGE_FORMAT_LAYOUT_32,
+						ZE_IMAGE_FORMAT_TYPE_FLOAT },
+					      width,
+					      height,
+					      0,
+					      0,
+					      0 };
+		ze_image_handle_t hImage;
+		CHECK(zeImageCreate(context, device, &imageDesc, &hImage));
+		double img_up = measure([&](ze_event_handle_t ev) {
+			CHECK(zeCommandListAppendImageCopyFromMemory(commands, hImage, h_buf,
+								     nullptr, ev, 0, nullptr));
+		});
+		double img_down = measure([&](ze_event_handle_t ev) {
+			CHECK(zeCommandListAppendImageCopyToMemory(commands, h_buf, hImage, nullptr,
+								   ev, 0, nullptr));
+		});
+		CHECK(zeImageDestroy(hImage));
+
+		/* vector_add moves 3 x bytes, device time from the kernel timestamps */
+		ze_group_count_t vaddCount = { (uint32_t)(bytes / (VADD_SZ * sizeof(int))), 1, 1 };
+		vector<double> ns;
+		for (int r = 0; r < reps; r++) {
+			CHECK(zeCommandListAppendLaunchKernel(commands, vadd, &vaddCount, hTsEvent,
+							      0, nullptr));
+			CHECK(zeEventHostSynchronize(hTsEvent, numeric_limits<uint64_t>::max()));
+			ns.push_back(kernelTimeNs(hTsEvent, props));
+			CHECK(zeEventHostReset(hTsEvent));
+		}
+		double vadd_gbs = 3.0 * bytes / percentile(ns, 0.5);
+
+		printf("%10zu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", bytes, h2d, d2h, pgbl, img_up,
+		       img_down, vadd_gbs);
+	}
+
+	zeMemFree(context, h_buf);
+	zeMemFree(context, d_buf);
+	zeMemFree(context, d_a);
+	zeMemFree(context, d_b);
+	zeMemFree(context, d_c);
+	zeMemFree(context, d_trace);
+	zeEventDestroy(hEvent);
+	zeEventDestroy(hTsEvent);
+	zeEventPoolDestroy(hPool);
+	zeCommandListDestroy(single);
+	zeCommandListDestroy(batch);
+	zeKernelDestroy(hello);
+	zeKernelDestroy(vadd);
+	zeModuleDestroy(hello_module);
+	zeModuleDestroy(vadd_module);
+	zeCommandQueueDestroy(queue);
+	zeCommandListDestroy(commands);
+	zeContextDestroy(context);
+
+	printf("done\n");
+	return 0;
+}
@@ -0,0 +1,76 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef CM_TRACE_H
+#define CM_TRACE_H
+
+#include "cm_trace_defs.h"
+
+// Kernel side of the device trace ring buffer, a printf replacement.
+//
+// CM_TRACE(level, buf, tag, v...) writes one fixed size record with the
+// thread ids, a timestamp and up to CM_TRACE_NVALUES values. The slot comes
+// from an atomic add on the header counter and wraps around, so the buffer
+// keeps the newest records. Records above CM_TRACE_LEVEL (0 when not set,
+// pass -DCM_TRACE_LEVEL=n to cmc) are not compiled in; with level 0 the
+// buffer argument stays in the kernel signature but is never touched.
+//
+//	CM_TRACE(CM_TRACE_INFO, trace, CM_TRACE_TAG('v', 'a', 'd', 'd'), offset);
+
+#ifndef CM_TRACE_LEVEL
+#define CM_TRACE_LEVEL CM_TRACE_OFF
+#endif
+
+#if CM_TRACE_LEVEL > CM_TRACE_OFF
+inline _GENX_ void cm_trace_emit(SurfaceIndex buf, uint level, uint tag, uint v0 = 0,
+				 uint v1 = 0, uint v2 = 0, uint v3 = 0, uint v4 = 0,
+				 uint v5 = 0)
+{
+	// lane 0 bumps the counter, the other lanes add 0 to the rest of the
+	// header so the message has no address conflicts
+	vector<uint, 8> offs(0, 1);
+	vector<uint, 8> inc = 0;
+	vector<uint, 8> old;
+	inc(0) = 1;
+	write_atomic<ATOMIC_ADD, uint, 8>(buf, offs, inc, old);
+
+	uint slot = old(0) & (old(1) - 1);
+
+	vector<uint, CM_TRACE_RECORD_DWORDS> rec;
+	vector<uint, 4> ts = cm_rdtsc();
+	rec(0) = tag;
+	rec(1) = level;
+	rec(2) = cm_linear_global_id();
+	rec(3) = cm_group_id(0);
+	rec(4) = cm_group_id(1);
+	rec(5) = cm_group_id(2);
+	rec(6) = cm_local_id(0);
+	rec(7) = cm_local_id(1);
+	rec(8) = ts(0);
+	rec(9) = ts(1);
+	rec(10) = v0;
+	rec(11) = v1;
+	rec(12) = v2;
+	rec(13) = v3;
+	rec(14) = v4;
+	rec(15) = v5;
+	write(buf, CM_TRACE_HEADER_BYTES + slot * CM_TRACE_RECORD_BYTES, rec);
+}
+
+#define CM_TRACE(level, buf, tag, ...)                                         \
+	do {                                                                   \
+		if ((level) <= CM_TRACE_LEVEL)                                 \
+			cm_trace_emit(buf, level, tag, ##__VA_ARGS__);         \
+	} while (0)
+#else
+#define CM_TRACE(level, buf, tag, ...)                                         \
+	do {                                                                   \
+	} while (0)
+#endif
+
+#endif
@@ -0,0 +1,41 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef CM_TRACE_DEFS_H
+#define CM_TRACE_DEFS_H
+
+// Layout of the device trace buffer, shared by the kernel side (cm_trace.h)
+// and the host decoder (cm_trace_host.h).
+//
+// The buffer starts with a 64 byte header followed by a power of two number
+// of 64 byte records. Header dword 0 is the number of records ever reserved,
+// dword 1 the capacity in records. A record is 16 dwords:
+//
+//   0       tag (four character code, see CM_TRACE_TAG)
+//   1       level
+//   2       cm_linear_global_id()
+//   3..5    cm_group_id(0..2)
+//   6..7    cm_local_id(0..1)
+//   8..9    timestamp, cm_rdtsc() low and high dword
+//   10..15  user values
+
+#define CM_TRACE_OFF 0
+#define CM_TRACE_ERROR 1
+#define CM_TRACE_INFO 2
+#define CM_TRACE_DEBUG 3
+
+#define CM_TRACE_HEADER_BYTES 64
+#define CM_TRACE_RECORD_DWORDS 16
+#define CM_TRACE_RECORD_BYTES (CM_TRACE_RECORD_DWORDS * 4)
+#define CM_TRACE_NVALUES 6
+
+#define CM_TRACE_TAG(a, b, c, d)                                               \
+	((unsigned)(a) | ((unsigned)(b) << 8) | ((unsigned)(c) << 16) |        \
+	 ((unsigned)(d) << 24))
+
+#endif
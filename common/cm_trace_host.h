@@ -0,0 +1,192 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef CM_TRACE_HOST_H
+#define CM_TRACE_HOST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "cm_trace_defs.h"
+#include "ze_check.h"
+
+// Host side of the device trace ring buffer (see cm_trace.h).
+//
+// CmTraceBuffer owns the ring in shared USM, data() is passed as the kernel
+// buffer argument. After the kernel has completed records() returns the
+// surviving records oldest first, print() pretty prints them and writeCsv()
+// exports them. A tag can be given a printf format for its values, records
+// without one print the values as plain numbers.
+
+struct cm_trace_record {
+	uint32_t tag;
+	uint32_t level;
+	uint32_t linear_id;
+	uint32_t group[3];
+	uint32_t local[2];
+	uint32_t ts_lo;
+	uint32_t ts_hi;
+	uint32_t v[CM_TRACE_NVALUES];
+
+	uint64_t timestamp() const
+	{
+		return ((uint64_t)ts_hi << 32) | ts_lo;
+	}
+};
+static_assert(sizeof(cm_trace_record) == CM_TRACE_RECORD_BYTES, "record layout");
+
+class CmTraceBuffer {
+	ze_context_handle_t context;
+	uint32_t *header;
+	cm_trace_record *ring;
+	uint32_t capacity;
+	std::map<uint32_t, std::string> formats;
+
+public:
+	// capacity is rounded up to a power of two
+	CmTraceBuffer(ze_context_handle_t context, ze_device_handle_t device,
+		      uint32_t capacity = 4096)
+		: context(context), header(nullptr), ring(nullptr), capacity(1)
+	{
+		while (this->capacity < capacity)
+			this->capacity <<= 1;
+
+		ze_device_mem_alloc_desc_t dev_desc = { ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC,
+							nullptr, 0, 0 };
+		ze_host_mem_alloc_desc_t host_desc = { ZE_STRUCTURE_TYPE_HOST_MEM_ALLOC_DESC,
+						       nullptr, 0 };
+		void *ptr = nullptr;
+		ZE_CHECK(zeMemAllocShared(context, &dev_desc, &host_desc,
+					  CM_TRACE_HEADER_BYTES +
+						  (size_t)this->capacity * CM_TRACE_RECORD_BYTES,
+					  CM_TRACE_HEADER_BYTES, device, &ptr));
+		header = (uint32_t *)ptr;
+		ring = (cm_trace_record *)((char *)ptr + CM_TRACE_HEADER_BYTES);
+		reset();
+	}
+
+	~CmTraceBuffer()
+	{
+		close();
+	}
+
+	CmTraceBuffer(const CmTraceBuffer &) = delete;
+	CmTraceBuffer &operator=(const CmTraceBuffer &) = delete;
+
+	// frees the ring, must be called before the context is destroyed
+	void close()
+	{
+		if (header == nullptr)
+			return;
+		ZE_CHECK(zeMemFree(context, header));
+		header = nullptr;
+		ring = nullptr;
+	}
+
+	void *data() const
+	{
+		return header;
+	}
+
+	// drops all records, the device must be idle
+	void reset()
+	{
+		memset(header, 0, CM_TRACE_HEADER_BYTES);
+		header[1] = capacity;
+	}
+
+	void setFormat(uint32_t tag, const char *fmt)
+	{
+		formats[tag] = fmt;
+	}
+
+	// records reserved by the device, including overwritten ones
+	uint32_t count() const
+	{
+		return header[0];
+	}
+
+	uint32_t dropped() const
+	{
+		return count() > capacity ? count() - capacity : 0;
+	}
+
+	std::vector<cm_trace_record> records() const
+	{
+		std::vector<cm_trace_record> out;
+		uint32_t n = count();
+		for (uint32_t i = dropped(); i != n; i++)
+			out.push_back(ring[i & (capacity - 1)]);
+		return out;
+	}
+
+	static std::string tagName(uint32_t tag)
+	{
+		std::string s;
+		for (int i = 0; i < 4; i++) {
+			char c = (char)(tag >> (8 * i));
+			s += (c >= 0x20 && c < 0x7f) ? c : '.';
+		}
+		return s;
+	}
+
+	void print(FILE *out = stdout) const
+	{
+		std::vector<cm_trace_record> recs = records();
+		uint64_t t0 = UINT64_MAX;
+		for (auto &r : recs)
+			t0 = std::min(t0, r.timestamp());
+
+		fprintf(out, "trace: %zu records, %u dropped\n", recs.size(), dropped());
+		for (auto &r : recs) {
+			fprintf(out, "[%s] +%-10llu gid=%-5u group=(%u,%u,%u) local=(%u,%u) ",
+				tagName(r.tag).c_str(),
+				(unsigned long long)(r.timestamp() - t0), r.linear_id, r.group[0],
+				r.group[1], r.group[2], r.local[0], r.local[1]);
+			auto fmt = formats.find(r.tag);
+			if (fmt != formats.end()) {
+				fprintf(out, fmt->second.c_str(), r.v[0], r.v[1], r.v[2], r.v[3],
+					r.v[4], r.v[5]);
+			} else {
+				for (int i = 0; i < CM_TRACE_NVALUES; i++)
+					fprintf(out, "%s%u", i ? " " : "", r.v[i]);
+			}
+			fprintf(out, "\n");
+		}
+	}
+
+	bool writeCsv(const char *path) const
+	{
+		FILE *f = fopen(path, "w");
+		if (f == nullptr)
+			return false;
+		fprintf(f, "tag,level,linear_id,group0,group1,group2,local0,local1,timestamp");
+		for (int i = 0; i < CM_TRACE_NVALUES; i++)
+			fprintf(f, ",v%d", i);
+		fprintf(f, "\n");
+		for (auto &r : records()) {
+			fprintf(f, "%s,%u,%u,%u,%u,%u,%u,%u,%llu", tagName(r.tag).c_str(), r.level,
+				r.linear_id, r.group[0], r.group[1], r.group[2], r.local[0],
+				r.local[1], (unsigned long long)r.timestamp());
+			for (int i = 0; i < CM_TRACE_NVALUES; i++)
+				fprintf(f, ",%u", r.v[i]);
+			fprintf(f, "\n");
+		}
+		fclose(f);
+		return true;
+	}
+};
+
+#endif
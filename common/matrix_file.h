@@ -0,0 +1,244 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary matrix files.
+//
+// A file is a 64 byte header, zero padding up to the payload offset (a
+// multiple of the page size) and the payload: rows x ld elements in row
+// major order. ld is a multiple of MATRIX_FILE_LD_ALIGN, the columns past
+// cols are zero, so a kernel that walks k in steps of 16 can read the
+// mapped payload as it is. All fields are little endian.
+//
+// MatrixFile::open() maps the payload copy-on-write and reads nothing but
+// the header: pages are faulted in when they are touched, writes to the
+// mapping never reach the file. The checksum is FNV-1a over the payload in
+// 8 byte words; computing it reads every page, so open() only checks it
+// when asked to, or when MATRIX_FILE_VERIFY=1 is set. MatrixFile::write()
+// streams the rows out through a bounded staging buffer, hashing them on
+// the way, and renames the file into place once the header is written.
+
+#define MATRIX_FILE_MAGIC "CMMATRIX"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_LD_ALIGN 16
+#define MATRIX_FILE_STAGING (4 << 20)
+
+enum matrix_file_dtype {
+	MATRIX_FILE_F32 = 1,
+};
+
+struct matrix_file_header {
+	char magic[8]; /* MATRIX_FILE_MAGIC, not terminated */
+	uint32_t version;
+	uint32_t dtype; /* matrix_file_dtype */
+	uint64_t rows;
+	uint64_t cols;
+	uint64_t ld; /* elements per payload row */
+	uint64_t offset; /* payload offset in bytes, a multiple of alignment */
+	uint64_t checksum; /* of the payload, 0 when it was not computed */
+	uint32_t alignment; /* payload alignment in bytes */
+	uint32_t reserved;
+};
+static_assert(sizeof(matrix_file_header) == 64, "matrix file header is 64 bytes");
+
+class MatrixFile {
+	matrix_file_header hdr;
+	void *map;
+	size_t map_bytes;
+
+	static size_t dtypeSize(uint32_t dtype)
+	{
+		return dtype == MATRIX_FILE_F32 ? sizeof(float) : 0;
+	}
+
+	static uint64_t hash(uint64_t h, const void *data, size_t bytes)
+	{
+		const uint64_t *w = (const uint64_t *)data;
+		for (size_t i = 0; i < bytes / 8; i++) {
+			h ^= w[i];
+			h *= 0x100000001b3ULL;
+		}
+		return h;
+	}
+
+	static bool fail(const char *path, const char *what)
+	{
+		fprintf(stderr, "WARN: %s: %s\n", path, what);
+		return false;
+	}
+
+	/* reads the header of path, maps the payload if map_payload is set */
+	bool load(const char *path, bool verify, bool map_payload)
+	{
+		close();
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return fail(path, strerror(errno));
+
+		struct stat st;
+		if (fstat(fd, &st) != 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+			::close(fd);
+			return fail(path, "no header");
+		}
+		size_t esize = dtypeSize(hdr.dtype);
+		size_t page = sysconf(_SC_PAGESIZE);
+		uint64_t payload = hdr.rows * hdr.ld * esize;
+		if (memcmp(hdr.magic, MATRIX_FILE_MAGIC, sizeof(hdr.magic)) != 0 ||
+		    hdr.version != MATRIX_FILE_VERSION || esize == 0 || hdr.ld < hdr.cols ||
+		    hdr.ld % MATRIX_FILE_LD_ALIGN != 0 || hdr.offset % page != 0 ||
+		    hdr.offset + payload > (uint64_t)st.st_size) {
+			::close(fd);
+			return fail(path, "not a valid matrix file");
+		}
+
+		map_bytes = map_payload ? payload : 0;
+		if (map_bytes != 0) {
+			map = mmap(nullptr, map_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd,
+				   hdr.offset);
+			if (map == MAP_FAILED) {
+				map = nullptr;
+				map_bytes = 0;
+				::close(fd);
+				return fail(path, strerror(errno));
+			}
+		}
+		::close(fd);
+
+		const char *env = getenv("MATRIX_FILE_VERIFY");
+		verify |= env != nullptr && strcmp(env, "1") == 0;
+		if (verify && map_payload && hdr.checksum != 0 &&
+		    hash(0xcbf29ce484222325ULL, map, map_bytes) != hdr.checksum) {
+			close();
+			return fail(path, "checksum mismatch");
+		}
+		return true;
+	}
+
+    public:
+	MatrixFile() : map(nullptr), map_bytes(0)
+	{
+		memset(&hdr, 0, sizeof(hdr));
+	}
+
+	~MatrixFile()
+	{
+		close();
+	}
+
+	MatrixFile(const MatrixFile &) = delete;
+	MatrixFile &operator=(const MatrixFile &) = delete;
+
+	// maps path, false with a warning on stderr if it is not a valid file
+	bool open(const char *path, bool verify = false)
+	{
+		return load(path, verify, true);
+	}
+
+	// rows x cols f32 matrix with pitch ld (in elements) -> path
+	static bool write(const char *path, const float *data, uint64_t rows, uint64_t cols,
+			  uint64_t ld)
+	{
+		matrix_file_header h;
+		memset(&h, 0, sizeof(h));
+		memcpy(h.magic, MATRIX_FILE_MAGIC, sizeof(h.magic));
+		h.version = MATRIX_FILE_VERSION;
+		h.dtype = MATRIX_FILE_F32;
+		h.rows = rows;
+		h.cols = cols;
+		h.ld = (cols + MATRIX_FILE_LD_ALIGN - 1) / MATRIX_FILE_LD_ALIGN;
+		h.ld *= MATRIX_FILE_LD_ALIGN;
+		h.alignment = sysconf(_SC_PAGESIZE);
+		h.offset = h.alignment;
+
+		std::string tmp = std::string(path) + ".tmp";
+		int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return fail(tmp.c_str(), strerror(errno));
+
+		/* the header goes in last, a partial file has no magic */
+		size_t row_bytes = h.ld * sizeof(float);
+		uint64_t batch = MATRIX_FILE_STAGING / row_bytes;
+		batch = batch == 0 ? 1 : batch;
+		std::vector<float> staging(batch * h.ld);
+		uint64_t sum = 0xcbf29ce484222325ULL;
+		bool ok = lseek(fd, h.offset, SEEK_SET) == (off_t)h.offset;
+		for (uint64_t r0 = 0; ok && r0 < rows; r0 += batch) {
+			uint64_t n = rows - r0 < batch ? rows - r0 : batch;
+			std::fill(staging.begin(), staging.end(), 0.0f);
+			for (uint64_t r = 0; r < n; r++)
+				memcpy(&staging[r * h.ld], data + (r0 + r) * ld,
+				       cols * sizeof(float));
+			sum = hash(sum, staging.data(), n * row_bytes);
+			ok = ::write(fd, staging.data(), n * row_bytes) == (ssize_t)(n * row_bytes);
+		}
+		h.checksum = sum;
+		ok = ok && pwrite(fd, &h, sizeof(h), 0) == sizeof(h);
+		/* an empty payload still needs the padded header page */
+		ok = ok && ftruncate(fd, h.offset + rows * row_bytes) == 0;
+		ok = ::close(fd) == 0 && ok;
+		if (!ok || rename(tmp.c_str(), path) != 0) {
+			unlink(tmp.c_str());
+			return fail(path, "write failed");
+		}
+		return true;
+	}
+
+	// dimensions of path, only its header is read; false if it is not a valid file
+	static bool peek(const char *path, uint64_t *rows, uint64_t *cols)
+	{
+		MatrixFile f;
+		if (!f.load(path, false, false))
+			return false;
+		*rows = f.rows();
+		*cols = f.cols();
+		return true;
+	}
+
+	float *data()
+	{
+		return (float *)map;
+	}
+	uint64_t rows()
+	{
+		return hdr.rows;
+	}
+	uint64_t cols()
+	{
+		return hdr.cols;
+	}
+	uint64_t ld()
+	{
+		return hdr.ld;
+	}
+
+	void close()
+	{
+		if (map != nullptr)
+			munmap(map, map_bytes);
+		map = nullptr;
+		map_bytes = 0;
+	}
+};
+
+#endif
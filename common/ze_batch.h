@@ -0,0 +1,375 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef ZE_BATCH_H
+#define ZE_BATCH_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "ze_check.h"
+
+// Submission service that coalesces small elementwise requests.
+//
+// The kernel is c := op(a, b) over buffers, arguments 0 and 1 are the
+// inputs, 2 the output and every thread (one per group) handles chunk_bytes
+// of each, vector_add of test_6 for example. Because such a kernel does not
+// care where one request ends and the next begins, requests are coalesced
+// by concatenation: submit() queues a request and returns a future, a
+// dispatcher thread waits up to window_us after the oldest queued request
+// for more to arrive (or for batch_bytes to be queued), packs the batch
+// into the host staging buffers of a free slot, each request starting on a
+// chunk boundary, and runs it with one upload, one launch and one download.
+// Slots are spread over the compute queues of the device round-robin, so up
+// to queues batches are in flight while the next one is packed. A completion
+// thread waits for the batches in submission order, copies the results out
+// and fulfills the futures.
+//
+// submit() may be called from any thread. a, b and c must stay valid until
+// the future is ready; the inputs are read by the dispatcher, not in
+// submit(). A request bigger than batch_bytes is a batch of its own.
+
+#define ZE_BATCH_QUEUES 2
+#define ZE_BATCH_WINDOW_US 50
+#define ZE_BATCH_BYTES (1 << 20)
+
+class ZeBatcher {
+	typedef std::chrono::steady_clock clock;
+
+	struct Request {
+		const void *a;
+		const void *b;
+		void *c;
+		size_t bytes;
+		size_t offset; /* in the staging buffers of the batch */
+		clock::time_point queued;
+		std::promise<void> done;
+	};
+
+	struct Slot {
+		ze_command_list_handle_t commands;
+		ze_kernel_handle_t kernel;
+		ze_event_handle_t event;
+		void *d_a, *d_b, *d_c;
+		char *h_a, *h_b, *h_c;
+		size_t capacity;
+		std::vector<Request> batch;
+		bool busy;
+	};
+
+	ze_context_handle_t context;
+	ze_device_handle_t device;
+	size_t chunk_bytes;
+	size_t batch_bytes;
+	clock::duration window;
+
+	ze_event_pool_handle_t pool;
+	std::vector<Slot> slots;
+
+	std::mutex lock;
+	std::condition_variable queued_cv; /* requests queued or stopping */
+	std::condition_variable slot_cv; /* a slot became free */
+	std::condition_variable inflight_cv; /* a batch was launched */
+	std::deque<Request> pending;
+	size_t pending_bytes;
+	std::deque<int> inflight; /* slots in submission order */
+	bool stopping;
+	bool dispatched; /* the dispatcher has launched its last batch */
+	bool closed;
+	std::thread dispatcher;
+	std::thread completer;
+
+	uint64_t requests;
+	uint64_t batches;
+	uint64_t bytes;
+
+	size_t padded(size_t n)
+	{
+		return (n + chunk_bytes - 1) / chunk_bytes * chunk_bytes;
+	}
+
+	/* called with the slot idle */
+	void reserve(Slot &s, size_t size)
+	{
+		if (size <= s.capacity)
+			return;
+		release(s);
+		ze_device_mem_alloc_desc_t ddesc = { ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC,
+						     nullptr, 0, 0 };
+		ze_host_mem_alloc_desc_t hdesc = { ZE_STRUCTURE_TYPE_HOST_MEM_ALLOC_DESC, nullptr,
+						   0 };
+		void **dev[] = { &s.d_a, &s.d_b, &s.d_c };
+		char **host[] = { &s.h_a, &s.h_b, &s.h_c };
+		for (int i = 0; i < 3; i++) {
+			ZE_CHECK(zeMemAllocDevice(context, &ddesc, size, 64, device, dev[i]));
+			ZE_CHECK(zeMemAllocHost(context, &hdesc, size, 64, (void **)host[i]));
+		}
+		s.capacity = size;
+	}
+
+	void release(Slot &s)
+	{
+		if (s.capacity == 0)
+			return;
+		void *ptrs[] = { s.d_a, s.d_b, s.d_c, s.h_a, s.h_b, s.h_c };
+		for (void *p : ptrs)
+			ZE_CHECK(zeMemFree(context, p));
+		s.capacity = 0;
+	}
+
+	/* packs the batch into the slot and appends upload, launch and download */
+	void launch(Slot &s)
+	{
+		size_t total = 0;
+		for (auto &r : s.batch) {
+			r.offset = total;
+			total += padded(r.bytes);
+		}
+		reserve(s, std::max(total, padded(batch_bytes)));
+		for (auto &r : s.batch) {
+			size_t pad = padded(r.bytes) - r.bytes;
+			memcpy(s.h_a + r.offset, r.a, r.bytes);
+			memcpy(s.h_b + r.offset, r.b, r.bytes);
+			memset(s.h_a + r.offset + r.bytes, 0, pad);
+			memset(s.h_b + r.offset + r.bytes, 0, pad);
+		}
+
+		ZE_CHECK(zeCommandListAppendMemoryCopy(s.commands, s.d_a, s.h_a, total, nullptr, 0,
+						       nullptr));
+		ZE_CHECK(zeCommandListAppendMemoryCopy(s.commands, s.d_b, s.h_b, total, nullptr, 0,
+						       nullptr));
+		ZE_CHECK(zeCommandListAppendBarrier(s.commands, nullptr, 0, nullptr));
+		ZE_CHECK(zeKernelSetArgumentValue(s.kernel, 0, sizeof(s.d_a), &s.d_a));
+		ZE_CHECK(zeKernelSetArgumentValue(s.kernel, 1, sizeof(s.d_b), &s.d_b));
+		ZE_CHECK(zeKernelSetArgumentValue(s.kernel, 2, sizeof(s.d_c), &s.d_c));
+		ze_group_count_t groupCount = { (uint32_t)(total / chunk_bytes), 1, 1 };
+		ZE_CHECK(zeCommandListAppendLaunchKernel(s.commands, s.kernel, &groupCount, nullptr,
+							 0, nullptr));
+		ZE_CHECK(zeCommandListAppendBarrier(s.commands, nullptr, 0, nullptr));
+		ZE_CHECK(zeCommandListAppendMemoryCopy(s.commands, s.h_c, s.d_c, total, nullptr, 0,
+						       nullptr));
+		ZE_CHECK(zeCommandListAppendBarrier(s.commands, s.event, 0, nullptr));
+	}
+
+	void dispatch()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		unsigned next = 0;
+		for (;;) {
+			queued_cv.wait(guard, [&] { return !pending.empty() || stopping; });
+			if (pending.empty()) {
+				dispatched = true;
+				inflight_cv.notify_one();
+				break;
+			}
+
+			/* coalescing window, opened by the oldest request */
+			queued_cv.wait_until(guard, pending.front().queued + window, [&] {
+				return pending_bytes >= batch_bytes || stopping;
+			});
+
+			int id = next++ % slots.size();
+			slot_cv.wait(guard, [&] { return !slots[id].busy; });
+			Slot &s = slots[id];
+			size_t size = 0;
+			while (!pending.empty() &&
+			       (s.batch.empty() || size + pending.front().bytes <= batch_bytes)) {
+				size += pending.front().bytes;
+				pending_bytes -= pending.front().bytes;
+				s.batch.push_back(std::move(pending.front()));
+				pending.pop_front();
+			}
+			s.busy = true;
+			requests += s.batch.size();
+			batches++;
+			bytes += size;
+
+			guard.unlock();
+			launch(s);
+			guard.lock();
+			inflight.push_back(id);
+			inflight_cv.notify_one();
+		}
+	}
+
+	void complete()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		for (;;) {
+			inflight_cv.wait(guard, [&] { return !inflight.empty() || dispatched; });
+			if (inflight.empty())
+				break;
+			Slot &s = slots[inflight.front()];
+			inflight.pop_front();
+			guard.unlock();
+
+			ZE_CHECK(zeEventHostSynchronize(s.event,
+							std::numeric_limits<uint64_t>::max()));
+			ZE_CHECK(zeEventHostReset(s.event));
+			for (auto &r : s.batch) {
+				memcpy(r.c, s.h_c + r.offset, r.bytes);
+				r.done.set_value();
+			}
+			s.batch.clear();
+
+			guard.lock();
+			s.busy = false;
+			slot_cv.notify_all();
+		}
+	}
+
+    public:
+	ZeBatcher(ze_context_handle_t context, ze_device_handle_t device, ze_module_handle_t module,
+		  const char *kernel_name, size_t chunk_bytes, unsigned queues = ZE_BATCH_QUEUES,
+		  unsigned window_us = ZE_BATCH_WINDOW_US, size_t batch_bytes = ZE_BATCH_BYTES)
+		: context(context)
+		, device(device)
+		, chunk_bytes(chunk_bytes)
+		, batch_bytes(batch_bytes)
+		, window(std::chrono::microseconds(window_us))
+		, pool(nullptr)
+		, slots(queues > 0 ? queues : 1)
+		, pending_bytes(0)
+		, stopping(false)
+		, dispatched(false)
+		, closed(false)
+		, requests(0)
+		, batches(0)
+		, bytes(0)
+	{
+		/* the slots go to the queues of the first compute group round-robin */
+		uint32_t count = 0;
+		ZE_CHECK(zeDeviceGetCommandQueueGroupProperties(device, &count, nullptr));
+		std::vector<ze_command_queue_group_properties_t> groups(count);
+		for (auto &g : groups)
+			g = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_GROUP_PROPERTIES };
+		ZE_CHECK(zeDeviceGetCommandQueueGroupProperties(device, &count, groups.data()));
+		uint32_t ordinal = 0, nqueues = 1;
+		for (uint32_t i = 0; i < count; i++) {
+			if (groups[i].flags & ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COMPUTE) {
+				ordinal = i;
+				nqueues = groups[i].numQueues > 0 ? groups[i].numQueues : 1;
+				break;
+			}
+		}
+
+		ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
+						   ZE_EVENT_POOL_FLAG_HOST_VISIBLE,
+						   (uint32_t)slots.size() };
+		ZE_CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &pool));
+
+		for (uint32_t i = 0; i < slots.size(); i++) {
+			Slot &s = slots[i];
+			ze_command_queue_desc_t queueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
+							      nullptr,
+							      ordinal,
+							      i % nqueues,
+							      0,
+							      ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+							      ZE_COMMAND_QUEUE_PRIORITY_NORMAL };
+			ZE_CHECK(zeCommandListCreateImmediate(context, device, &queueDesc,
+							      &s.commands));
+
+			/* kernel arguments are per handle, every slot gets its own */
+			ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0,
+							kernel_name };
+			ZE_CHECK(zeKernelCreate(module, &kernelDesc, &s.kernel));
+			ZE_CHECK(zeKernelSetGroupSize(s.kernel, 1, 1, 1));
+
+			ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, i,
+						 ZE_EVENT_SCOPE_FLAG_HOST,
+						 ZE_EVENT_SCOPE_FLAG_HOST };
+			ZE_CHECK(zeEventCreate(pool, &desc, &s.event));
+			s.capacity = 0;
+			s.busy = false;
+		}
+
+		dispatcher = std::thread(&ZeBatcher::dispatch, this);
+		completer = std::thread(&ZeBatcher::complete, this);
+	}
+
+	~ZeBatcher()
+	{
+		close();
+	}
+
+	ZeBatcher(const ZeBatcher &) = delete;
+	ZeBatcher &operator=(const ZeBatcher &) = delete;
+
+	// c := op(a, b) over bytes bytes, ready when the future is
+	std::future<void> submit(const void *a, const void *b, void *c, size_t bytes)
+	{
+		Request r;
+		r.a = a;
+		r.b = b;
+		r.c = c;
+		r.bytes = bytes;
+		r.offset = 0;
+		r.queued = clock::now();
+		std::future<void> done = r.done.get_future();
+		if (bytes == 0) {
+			r.done.set_value();
+			return done;
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		pending_bytes += bytes;
+		pending.push_back(std::move(r));
+		queued_cv.notify_one();
+		return done;
+	}
+
+	void printStats(const char *name)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		printf("%s: %llu requests in %llu batches, %.1f requests and %.1f KiB per batch\n",
+		       name, (unsigned long long)requests, (unsigned long long)batches,
+		       batches ? (double)requests / batches : 0.0,
+		       batches ? bytes / 1024.0 / batches : 0.0);
+	}
+
+	// finishes every queued request and destroys the queues, must be
+	// called before the context is destroyed
+	void close()
+	{
+		if (closed)
+			return;
+		closed = true;
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+			queued_cv.notify_all();
+		}
+		/* the dispatcher flushes the queue, the completer the batches in flight */
+		dispatcher.join();
+		completer.join();
+
+		for (auto &s : slots) {
+			release(s);
+			ZE_CHECK(zeEventDestroy(s.event));
+			ZE_CHECK(zeKernelDestroy(s.kernel));
+			ZE_CHECK(zeCommandListDestroy(s.commands));
+		}
+		ZE_CHECK(zeEventPoolDestroy(pool));
+	}
+};
+
+#endif
@@ -0,0 +1,27 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef ZE_CHECK_H
+#define ZE_CHECK_H
+
+#include <cstdio>
+#include <cstdlib>
+
+// same contract as CHECK in the test hosts, kept under its own name so the
+// common headers do not clash with the macros every host defines
+#define ZE_CHECK(a)                                                           \
+	do {                                                                  \
+		auto err = (a);                                               \
+		if (err != 0) {                                               \
+			fprintf(stderr, "FAIL: err=%d @ %s:%d (%s)\n", err,   \
+				__FILE__, __LINE__, (#a));                    \
+			exit(err);                                            \
+		}                                                             \
+	} while (0)
+
+#endif
@@ -0,0 +1,99 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef ZE_DEVICES_H
+#define ZE_DEVICES_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "ze_check.h"
+
+// Device enumeration and work partitioning for multi-GPU / multi-tile runs.
+//
+// zeLeafDevices() returns every GPU of a driver, a device with sub-devices
+// (tiles) as its sub-devices, so each entry is one independent engine
+// that gets its own queue. ZE_FAKE_DEVICES=n stands in for a bigger node:
+// the list is repeated until it has n entries, every copy still runs on
+// real hardware but is scheduled as a device of its own, which is enough
+// to exercise the partitioning, the per-device queues and the gather.
+
+// every GPU of the driver, tiles instead of their root device
+static inline std::vector<ze_device_handle_t> zeLeafDevices(ze_driver_handle_t driver)
+{
+	std::vector<ze_device_handle_t> leaves;
+
+	uint32_t deviceCount = 0;
+	ZE_CHECK(zeDeviceGet(driver, &deviceCount, nullptr));
+	std::vector<ze_device_handle_t> devices(deviceCount);
+	ZE_CHECK(zeDeviceGet(driver, &deviceCount, devices.data()));
+
+	for (ze_device_handle_t device : devices) {
+		ze_device_properties_t props = { ZE_STRUCTURE_TYPE_DEVICE_PROPERTIES };
+		ZE_CHECK(zeDeviceGetProperties(device, &props));
+		if (props.type != ZE_DEVICE_TYPE_GPU)
+			continue;
+
+		uint32_t subCount = 0;
+		ZE_CHECK(zeDeviceGetSubDevices(device, &subCount, nullptr));
+		if (subCount == 0) {
+			leaves.push_back(device);
+			continue;
+		}
+		std::vector<ze_device_handle_t> subs(subCount);
+		ZE_CHECK(zeDeviceGetSubDevices(device, &subCount, subs.data()));
+		leaves.insert(leaves.end(), subs.begin(), subs.end());
+	}
+
+	const char *fake = getenv("ZE_FAKE_DEVICES");
+	if (fake != nullptr && !leaves.empty()) {
+		size_t real = leaves.size();
+		size_t want = strtoul(fake, nullptr, 10);
+		for (size_t i = real; i < want; i++)
+			leaves.push_back(leaves[i % real]);
+		if (want > 0 && want < real)
+			leaves.resize(want);
+	}
+	return leaves;
+}
+
+// splits n units into one block per weight, proportional to the weights;
+// every block but the last is a multiple of align, blocks may be empty
+static inline std::vector<uint32_t> zePartition(uint32_t n, const std::vector<double> &weights,
+						uint32_t align = 1)
+{
+	std::vector<uint32_t> sizes(weights.size(), 0);
+	if (weights.empty())
+		return sizes;
+
+	double total = 0.0;
+	for (double w : weights)
+		total += w > 0.0 ? w : 0.0;
+
+	uint32_t left = n;
+	double acc = 0.0;
+	for (size_t i = 0; i + 1 < weights.size(); i++) {
+		/* cut at the rounded cumulative share, rounding errors do not pile up */
+		acc += weights[i] > 0.0 ? weights[i] : 0.0;
+		double share = total > 0.0 ? acc / total : (double)(i + 1) / weights.size();
+		uint32_t end = (uint32_t)llround(n * share / align) * align;
+		end = end > n ? n : end;
+		uint32_t start = n - left;
+		sizes[i] = end > start ? end - start : 0;
+		left -= sizes[i];
+	}
+	sizes.back() = left;
+	return sizes;
+}
+
+#endif
@@ -0,0 +1,394 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef ZE_POOL_H
+#define ZE_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "ze_check.h"
+
+// Suballocator over large zeMemAllocDevice/zeMemAllocHost slabs.
+//
+// Requests up to ZE_POOL_MAX_CLASS bytes are rounded up to a power of two
+// size class and carved out of ZE_POOL_SLAB_SIZE slabs, bigger requests get
+// their own driver allocation rounded to ZE_POOL_LARGE_ALIGN that is kept on
+// free and handed out again for the same rounded size. Nothing is returned
+// to the driver before trim() or the pool destructor.
+//
+// Freed small blocks go to a per-thread cache of ZE_POOL_CACHE_DEPTH blocks
+// per class first, so an alloc/free pair in a request loop does not take the
+// pool lock. A cache belongs to the pool, blocks left in the cache of an
+// exited thread stay there until the pool is destroyed.
+//
+// free() takes the size that was passed to alloc(), the pool keeps no per
+// block header since device memory is not host readable.
+
+#define ZE_POOL_MIN_CLASS 256
+#define ZE_POOL_MAX_CLASS (1 << 20)
+#define ZE_POOL_SLAB_SIZE (4 << 20)
+#define ZE_POOL_LARGE_ALIGN (1 << 20)
+#define ZE_POOL_CACHE_DEPTH 8
+#define ZE_POOL_ALIGN 64
+
+enum ze_pool_kind { ZE_POOL_DEVICE, ZE_POOL_HOST };
+
+struct ze_pool_stats {
+	size_t reserved; /* bytes held from the driver */
+	size_t in_use; /* bytes handed out, rounded to size classes */
+	size_t requested; /* bytes asked for by live allocations */
+	size_t high_water; /* peak of in_use */
+	uint64_t driver_allocs; /* zeMemAlloc* calls made by the pool */
+	uint64_t allocs;
+	uint64_t frees;
+
+	/* share of in_use lost to size class rounding */
+	double internalFragmentation() const
+	{
+		return in_use ? 1.0 - (double)requested / in_use : 0.0;
+	}
+	/* share of reserved memory that is free */
+	double externalFragmentation() const
+	{
+		return reserved ? 1.0 - (double)in_use / reserved : 0.0;
+	}
+};
+
+class ZePool {
+	static const int NCLASSES = 13; /* 256 B .. 1 MiB */
+
+	struct ThreadCache {
+		std::vector<void *> bins[NCLASSES];
+	};
+
+	ze_context_handle_t context;
+	ze_device_handle_t device;
+	ze_pool_kind kind;
+	size_t slab_size;
+	uint64_t id;
+
+	std::mutex lock;
+	std::vector<void *> slabs;
+	std::vector<void *> bins[NCLASSES];
+	std::map<size_t, std::vector<void *> > large_free;
+	std::vector<std::pair<void *, size_t> > large_all;
+	std::vector<std::unique_ptr<ThreadCache> > caches;
+
+	std::atomic<size_t> reserved;
+	std::atomic<size_t> in_use;
+	std::atomic<size_t> requested;
+	std::atomic<size_t> high_water;
+	std::atomic<uint64_t> driver_allocs;
+	std::atomic<uint64_t> allocs;
+	std::atomic<uint64_t> frees;
+
+	static uint64_t nextId()
+	{
+		static std::atomic<uint64_t> ids(1);
+		return ids++;
+	}
+
+	static int sizeClass(size_t size)
+	{
+		int c = 0;
+		size_t s = ZE_POOL_MIN_CLASS;
+		while (s < size) {
+			s <<= 1;
+			c++;
+		}
+		return c;
+	}
+
+	static size_t classSize(int c)
+	{
+		return (size_t)ZE_POOL_MIN_CLASS << c;
+	}
+
+	void *driverAlloc(size_t size, size_t align)
+	{
+		void *ptr = nullptr;
+		if (kind == ZE_POOL_DEVICE) {
+			ze_device_mem_alloc_desc_t desc = { ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC,
+							    nullptr, 0, 0 };
+			ZE_CHECK(zeMemAllocDevice(context, &desc, size, align, device, &ptr));
+		} else {
+			ze_host_mem_alloc_desc_t desc = { ZE_STRUCTURE_TYPE_HOST_MEM_ALLOC_DESC,
+							  nullptr, 0 };
+			ZE_CHECK(zeMemAllocHost(context, &desc, size, align, &ptr));
+		}
+		driver_allocs++;
+		reserved += size;
+		return ptr;
+	}
+
+	ThreadCache &cache()
+	{
+		thread_local std::unordered_map<uint64_t, ThreadCache *> mine;
+		ThreadCache *&tc = mine[id];
+		if (tc == nullptr) {
+			std::lock_guard<std::mutex> guard(lock);
+			caches.emplace_back(new ThreadCache());
+			tc = caches.back().get();
+		}
+		return *tc;
+	}
+
+	/* called with the lock held */
+	void refill(int c)
+	{
+		size_t bsize = classSize(c);
+		char *slab = (char *)driverAlloc(slab_size, ZE_POOL_ALIGN);
+		slabs.push_back(slab);
+		for (size_t off = 0; off + bsize <= slab_size; off += bsize)
+			bins[c].push_back(slab + off);
+	}
+
+	void account(size_t rounded, size_t size)
+	{
+		size_t now = (in_use += rounded);
+		requested += size;
+		allocs++;
+
+		size_t peak = high_water.load();
+		while (now > peak && !high_water.compare_exchange_weak(peak, now))
+			;
+	}
+
+    public:
+	ZePool(ze_context_handle_t context, ze_device_handle_t device, ze_pool_kind kind,
+	       size_t slab_size = ZE_POOL_SLAB_SIZE)
+		: context(context)
+		, device(device)
+		, kind(kind)
+		, slab_size(slab_size < ZE_POOL_MAX_CLASS ? ZE_POOL_MAX_CLASS : slab_size)
+		, id(nextId())
+		, reserved(0)
+		, in_use(0)
+		, requested(0)
+		, high_water(0)
+		, driver_allocs(0)
+		, allocs(0)
+		, frees(0)
+	{
+	}
+
+	ZePool(const ZePool &) = delete;
+	ZePool &operator=(const ZePool &) = delete;
+
+	~ZePool()
+	{
+		for (auto slab : slabs)
+			ZE_CHECK(zeMemFree(context, slab));
+		for (auto &block : large_all)
+			ZE_CHECK(zeMemFree(context, block.first));
+	}
+
+	void *alloc(size_t size)
+	{
+		if (size == 0)
+			size = 1;
+
+		if (size > ZE_POOL_MAX_CLASS) {
+			size_t rounded = (size + ZE_POOL_LARGE_ALIGN - 1) & ~(size_t)(ZE_POOL_LARGE_ALIGN - 1);
+			void *ptr = nullptr;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				auto it = large_free.find(rounded);
+				if (it != large_free.end() && !it->second.empty()) {
+					ptr = it->second.back();
+					it->second.pop_back();
+				} else {
+					ptr = driverAlloc(rounded, ZE_POOL_ALIGN);
+					large_all.emplace_back(ptr, rounded);
+				}
+			}
+			account(rounded, size);
+			return ptr;
+		}
+
+		int c = sizeClass(size);
+		std::vector<void *> &local = cache().bins[c];
+		if (local.empty()) {
+			std::lock_guard<std::mutex> guard(lock);
+			if (bins[c].empty())
+				refill(c);
+			/* take up to half a cache worth, the rest stays shared */
+			size_t n = std::min<size_t>(bins[c].size(), ZE_POOL_CACHE_DEPTH / 2);
+			local.insert(local.end(), bins[c].end() - n, bins[c].end());
+			bins[c].resize(bins[c].size() - n);
+		}
+
+		void *ptr = local.back();
+		local.pop_back();
+		account(classSize(c), size);
+		return ptr;
+	}
+
+	void free(void *ptr, size_t size)
+	{
+		if (ptr == nullptr)
+			return;
+		if (size == 0)
+			size = 1;
+
+		frees++;
+		requested -= size;
+
+		if (size > ZE_POOL_MAX_CLASS) {
+			size_t rounded = (size + ZE_POOL_LARGE_ALIGN - 1) & ~(size_t)(ZE_POOL_LARGE_ALIGN - 1);
+			in_use -= rounded;
+			std::lock_guard<std::mutex> guard(lock);
+			large_free[rounded].push_back(ptr);
+			return;
+		}
+
+		int c = sizeClass(size);
+		in_use -= classSize(c);
+		std::vector<void *> &local = cache().bins[c];
+		local.push_back(ptr);
+		if (local.size() > ZE_POOL_CACHE_DEPTH) {
+			std::lock_guard<std::mutex> guard(lock);
+			size_t n = ZE_POOL_CACHE_DEPTH / 2;
+			bins[c].insert(bins[c].end(), local.end() - n, local.end());
+			local.resize(local.size() - n);
+		}
+	}
+
+	/* give cached large blocks back to the driver */
+	void trim()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto &bucket : large_free) {
+			for (auto ptr : bucket.second) {
+				ZE_CHECK(zeMemFree(context, ptr));
+				reserved -= bucket.first;
+				for (auto it = large_all.begin(); it != large_all.end(); ++it)
+					if (it->first == ptr) {
+						large_all.erase(it);
+						break;
+					}
+			}
+		}
+		large_free.clear();
+	}
+
+	ze_pool_stats stats() const
+	{
+		ze_pool_stats s;
+		s.reserved = reserved;
+		s.in_use = in_use;
+		s.requested = requested;
+		s.high_water = high_water;
+		s.driver_allocs = driver_allocs;
+		s.allocs = allocs;
+		s.frees = frees;
+		return s;
+	}
+
+	void printStats(const char *name) const
+	{
+		ze_pool_stats s = stats();
+		printf("%s: reserved %zu KiB, in use %zu KiB, high water %zu KiB, "
+		       "%llu driver allocs for %llu allocs, fragmentation internal %.1f%% "
+		       "external %.1f%%\n",
+		       name, s.reserved >> 10, s.in_use >> 10, s.high_water >> 10,
+		       (unsigned long long)s.driver_allocs, (unsigned long long)s.allocs,
+		       100.0 * s.internalFragmentation(), 100.0 * s.externalFragmentation());
+	}
+};
+
+// Reuse of image handles. An image is keyed by its format, flags and
+// dimensions, release() keeps the handle for the next acquire() with the
+// same key instead of destroying it.
+class ZeImageCache {
+	typedef std::tuple<int, int, uint32_t, int, uint64_t, uint32_t, uint32_t> Key;
+
+	ze_context_handle_t context;
+	ze_device_handle_t device;
+
+	std::mutex lock;
+	std::map<Key, std::vector<ze_image_handle_t> > free_images;
+	std::unordered_map<ze_image_handle_t, Key> live;
+
+	uint64_t created;
+	uint64_t reused;
+
+	static Key makeKey(const ze_image_desc_t &desc)
+	{
+		return Key(desc.format.layout, desc.format.type, desc.flags, desc.type, desc.width,
+			   desc.height, desc.depth);
+	}
+
+    public:
+	ZeImageCache(ze_context_handle_t context, ze_device_handle_t device)
+		: context(context)
+		, device(device)
+		, created(0)
+		, reused(0)
+	{
+	}
+
+	ZeImageCache(const ZeImageCache &) = delete;
+	ZeImageCache &operator=(const ZeImageCache &) = delete;
+
+	~ZeImageCache()
+	{
+		for (auto &bucket : free_images)
+			for (auto hImage : bucket.second)
+				zeImageDestroy(hImage);
+		for (auto &image : live)
+			zeImageDestroy(image.first);
+	}
+
+	ze_image_handle_t acquire(const ze_image_desc_t &desc)
+	{
+		Key key = makeKey(desc);
+		std::lock_guard<std::mutex> guard(lock);
+
+		ze_image_handle_t hImage = nullptr;
+		auto it = free_images.find(key);
+		if (it != free_images.end() && !it->second.empty()) {
+			hImage = it->second.back();
+			it->second.pop_back();
+			reused++;
+		} else {
+			ZE_CHECK(zeImageCreate(context, device, &desc, &hImage));
+			created++;
+		}
+		live[hImage] = key;
+		return hImage;
+	}
+
+	void release(ze_image_handle_t hImage)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		auto it = live.find(hImage);
+		if (it == live.end())
+			return;
+		free_images[it->second].push_back(hImage);
+		live.erase(it);
+	}
+
+	void printStats(const char *name)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		printf("%s: %llu images created, %llu reused, %zu live\n", name,
+		       (unsigned long long)created, (unsigned long long)reused, live.size());
+	}
+};
+
+#endif
@@ -0,0 +1,226 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef ZE_SPEC_H
+#define ZE_SPEC_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "ze_check.h"
+
+// Cache of shape specialized kernels.
+//
+// CM kernels reach the driver as SPIR-V that cmc has already compiled, so
+// -D defines cannot be applied at zeModuleCreate time. A specialization is
+// instead a separate binary built by cmc with the defines of its key, next
+// to the generic one: kernel.spv.skl is specialized for key "k256" by
+// kernel.k256.spv.skl (see specPath()). Extra build options and SPIR-V spec
+// constants are passed to zeModuleCreate with the key, which must then
+// identify the constants as well.
+//
+// kernel(name, key) returns the kernel from the specialized module, built
+// once and cached per (key, options) and per (kernel, key). When the binary
+// is missing or does not build, the generic kernel is returned and the
+// miss is cached as well, so a hot loop pays a map lookup either way.
+// Kernel handles are shared by all callers asking for the same (kernel,
+// key), their arguments are not synchronized.
+
+#define ZE_SPEC_BUILD_OPTIONS "-vc-codegen"
+
+class ZeSpecCache {
+	struct Module {
+		ze_module_handle_t module;
+		bool specialized;
+	};
+
+	ze_context_handle_t context;
+	ze_device_handle_t device;
+	std::string generic_path;
+	std::string build_options;
+
+	std::mutex lock;
+	std::map<std::string, Module> modules;
+	std::map<std::pair<std::string, std::string>, ze_kernel_handle_t> kernels;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t fallbacks;
+
+	static bool readFile(const std::string &path, std::vector<unsigned char> &code)
+	{
+		FILE *fp = fopen(path.c_str(), "rb");
+		if (fp == nullptr)
+			return false;
+		fseek(fp, 0, SEEK_END);
+		code.resize(ftell(fp));
+		rewind(fp);
+		size_t ret = fread(code.data(), 1, code.size(), fp);
+		fclose(fp);
+		return ret == code.size();
+	}
+
+	/* nullptr if the module does not build, the build log goes to stderr */
+	ze_module_handle_t build(const std::string &path, const std::string &options,
+				 const ze_module_constants_t *constants)
+	{
+		std::vector<unsigned char> code;
+		if (!readFile(path, code))
+			return nullptr;
+
+		std::string opts = options.empty() ? build_options : build_options + " " + options;
+		ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
+						nullptr,
+						ZE_MODULE_FORMAT_IL_SPIRV,
+						code.size(),
+						code.data(),
+						opts.c_str(),
+						constants };
+		ze_module_handle_t module = nullptr;
+		ze_module_build_log_handle_t log = nullptr;
+		if (zeModuleCreate(context, device, &moduleDesc, &module, &log) !=
+		    ZE_RESULT_SUCCESS) {
+			size_t size = 0;
+			zeModuleBuildLogGetString(log, &size, nullptr);
+			std::string text(size, '\0');
+			zeModuleBuildLogGetString(log, &size, &text[0]);
+			fprintf(stderr, "WARN: %s does not build: %s\n", path.c_str(),
+				text.c_str());
+			module = nullptr;
+		}
+		if (log != nullptr)
+			zeModuleBuildLogDestroy(log);
+		return module;
+	}
+
+	/* called with the lock held */
+	Module &module(const std::string &key, const std::string &options,
+		       const ze_module_constants_t *constants)
+	{
+		std::string id = key + "|" + options;
+		auto it = modules.find(id);
+		if (it != modules.end())
+			return it->second;
+
+		Module m = { nullptr, false };
+		if (key.empty() && options.empty()) {
+			m.module = build(generic_path, "", nullptr);
+			if (m.module == nullptr) {
+				fprintf(stderr, "FAIL: unable to build %s\n", generic_path.c_str());
+				exit(-1);
+			}
+		} else {
+			m.module = build(specPath(generic_path, key), options, constants);
+			m.specialized = m.module != nullptr;
+			if (!m.specialized) {
+				fallbacks++;
+				m.module = module("", "", nullptr).module;
+			}
+		}
+		return modules[id] = m;
+	}
+
+    public:
+	ZeSpecCache(ze_context_handle_t context, ze_device_handle_t device,
+		    const char *generic_path, const char *build_options = ZE_SPEC_BUILD_OPTIONS)
+		: context(context)
+		, device(device)
+		, generic_path(generic_path)
+		, build_options(build_options)
+		, hits(0)
+		, misses(0)
+		, fallbacks(0)
+	{
+	}
+
+	~ZeSpecCache()
+	{
+		close();
+	}
+
+	ZeSpecCache(const ZeSpecCache &) = delete;
+	ZeSpecCache &operator=(const ZeSpecCache &) = delete;
+
+	// kernel.spv.skl + "k256" -> kernel.k256.spv.skl
+	static std::string specPath(const std::string &generic, const std::string &key)
+	{
+		if (key.empty())
+			return generic;
+		size_t slash = generic.rfind('/');
+		size_t dot = generic.find('.', slash == std::string::npos ? 0 : slash + 1);
+		if (dot == std::string::npos)
+			return generic + "." + key;
+		return generic.substr(0, dot) + "." + key + generic.substr(dot);
+	}
+
+	// the kernel specialized for key, or the generic one; specialized
+	// tells which of the two it is
+	ze_kernel_handle_t kernel(const char *name, const std::string &key = "",
+				  const std::string &options = "",
+				  const ze_module_constants_t *constants = nullptr,
+				  bool *specialized = nullptr)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		Module &m = module(key, options, constants);
+		if (specialized != nullptr)
+			*specialized = m.specialized;
+
+		auto id = std::make_pair(std::string(name), key + "|" + options);
+		auto it = kernels.find(id);
+		if (it != kernels.end()) {
+			hits++;
+			return it->second;
+		}
+		misses++;
+
+		/* kernels of the same module are shared, zeKernelCreate is per name */
+		ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0, name };
+		ze_kernel_handle_t kernel = nullptr;
+		ZE_CHECK(zeKernelCreate(m.module, &kernelDesc, &kernel));
+		return kernels[id] = kernel;
+	}
+
+	void printStats(const char *name)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		printf("%s: %zu modules, %zu kernels, %llu hits, %llu misses, %llu fallbacks\n",
+		       name, modules.size(), kernels.size(), (unsigned long long)hits,
+		       (unsigned long long)misses, (unsigned long long)fallbacks);
+	}
+
+	// destroys all kernels and modules, must be called before the
+	// context is destroyed
+	void close()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto &it : kernels)
+			ZE_CHECK(zeKernelDestroy(it.second));
+		kernels.clear();
+
+		std::vector<ze_module_handle_t> destroyed;
+		for (auto &it : modules) {
+			ze_module_handle_t module = it.second.module;
+			bool seen = false;
+			for (auto d : destroyed)
+				seen |= d == module;
+			if (!seen) {
+				ZE_CHECK(zeModuleDestroy(module));
+				destroyed.push_back(module);
+			}
+		}
+		modules.clear();
+	}
+};
+
+#endif
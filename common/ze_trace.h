@@ -0,0 +1,418 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef ZE_TRACE_H
+#define ZE_TRACE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "ze_check.h"
+
+// Host/device timeline written as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev).
+//
+// The tracer is switched on by the ZE_TRACE environment variable that names
+// the output file. The append wrappers then signal an event from a managed
+// KERNEL_TIMESTAMP event pool and the device start/end of every command is
+// put on the host steady_clock timeline, one track per command list. Host
+// work is recorded with ZeTraceScope. When tracing is off every wrapper is a
+// single branch around the plain zeCommandListAppend* call.
+//
+// A command that the caller gives its own signal event keeps that event, the
+// record is read back when the caller waits through hostSynchronize(). Such
+// an event must come from a KERNEL_TIMESTAMP pool to show up in the trace.
+
+#define ZE_TRACE_POOL_SIZE 256
+#define ZE_TRACE_TIMEOUT 1000000000ULL
+
+class ZeTracer {
+	typedef std::chrono::steady_clock clock;
+
+	struct Pending {
+		std::string name;
+		const char *cat;
+		ze_event_handle_t event;
+		bool borrowed;
+		int track;
+	};
+
+	struct Record {
+		std::string name;
+		const char *cat;
+		int pid;
+		int tid;
+		double ts; /* us since the tracer was created */
+		double dur;
+	};
+
+	bool on;
+	std::string path;
+	ze_context_handle_t context;
+	ze_device_handle_t device;
+	ze_device_properties_t props;
+	clock::time_point origin;
+
+	/* device global timer <-> steady_clock correlation */
+	double sync_host_us;
+	uint64_t sync_dev_ticks;
+
+	std::mutex lock;
+	std::vector<ze_event_pool_handle_t> pools;
+	std::vector<ze_event_handle_t> all_events;
+	std::vector<ze_event_handle_t> free_events;
+	std::vector<Pending> pending;
+	std::vector<Record> records;
+	std::map<ze_command_list_handle_t, int> tracks;
+	std::map<std::thread::id, int> threads;
+
+	ze_event_handle_t getEvent()
+	{
+		if (free_events.empty()) {
+			ze_event_pool_desc_t pool_desc = {
+				ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
+				ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP | ZE_EVENT_POOL_FLAG_HOST_VISIBLE,
+				ZE_TRACE_POOL_SIZE
+			};
+			ze_event_pool_handle_t hPool;
+			ZE_CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &hPool));
+			pools.push_back(hPool);
+
+			for (uint32_t i = 0; i < ZE_TRACE_POOL_SIZE; i++) {
+				ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, i,
+							 ZE_EVENT_SCOPE_FLAG_HOST,
+							 ZE_EVENT_SCOPE_FLAG_HOST };
+				ze_event_handle_t hEvent;
+				ZE_CHECK(zeEventCreate(hPool, &desc, &hEvent));
+				all_events.push_back(hEvent);
+				free_events.push_back(hEvent);
+			}
+		}
+		ze_event_handle_t hEvent = free_events.back();
+		free_events.pop_back();
+		return hEvent;
+	}
+
+	int track(ze_command_list_handle_t list)
+	{
+		auto it = tracks.find(list);
+		if (it != tracks.end())
+			return it->second;
+		int id = tracks.size();
+		tracks[list] = id;
+		return id;
+	}
+
+	int threadId()
+	{
+		auto it = threads.find(std::this_thread::get_id());
+		if (it != threads.end())
+			return it->second;
+		int id = threads.size();
+		threads[std::this_thread::get_id()] = id;
+		return id;
+	}
+
+	double hostUs(clock::time_point t) const
+	{
+		return std::chrono::duration<double, std::micro>(t - origin).count();
+	}
+
+	/* device ticks (masked to the kernel timestamp width) to trace us */
+	double deviceUs(uint64_t ticks) const
+	{
+		uint32_t bits = props.kernelTimestampValidBits;
+		uint64_t mask = bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+		int64_t delta = (ticks - sync_dev_ticks) & mask;
+		if (bits < 64 && delta > (int64_t)(mask >> 1))
+			delta -= (int64_t)mask + 1;
+		return sync_host_us + delta * (double)props.timerResolution / 1000.0;
+	}
+
+	/* called with the lock held, event is known to be signaled */
+	void harvest(const Pending &p)
+	{
+		ze_kernel_timestamp_result_t ts;
+		if (zeEventQueryKernelTimestamp(p.event, &ts) == ZE_RESULT_SUCCESS) {
+			double start = deviceUs(ts.global.kernelStart);
+			double end = deviceUs(ts.global.kernelEnd);
+			records.push_back({ p.name, p.cat, 1, p.track, start, end - start });
+		}
+		if (!p.borrowed) {
+			ZE_CHECK(zeEventHostReset(p.event));
+			free_events.push_back(p.event);
+		}
+	}
+
+	ze_event_handle_t begin(ze_command_list_handle_t list, ze_event_handle_t signal,
+				const char *name, const char *cat)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		ze_event_handle_t hEvent = signal != nullptr ? signal : getEvent();
+		pending.push_back({ name, cat, hEvent, signal != nullptr, track(list) });
+		return hEvent;
+	}
+
+	static void escape(FILE *fp, const std::string &s)
+	{
+		for (char c : s) {
+			if (c == '"' || c == '\\')
+				fputc('\\', fp);
+			fputc(c, fp);
+		}
+	}
+
+    public:
+	ZeTracer(ze_context_handle_t context, ze_device_handle_t device,
+		 const char *out = getenv("ZE_TRACE"))
+		: on(out != nullptr && out[0] != '\0')
+		, path(on ? out : "")
+		, context(context)
+		, device(device)
+		, origin(clock::now())
+		, sync_host_us(0.0)
+		, sync_dev_ticks(0)
+	{
+		if (!on)
+			return;
+
+		ZE_CHECK(zeDeviceGetProperties(device, &props));
+
+		uint64_t host_ts, dev_ts;
+		clock::time_point t0 = clock::now();
+		ZE_CHECK(zeDeviceGetGlobalTimestamps(device, &host_ts, &dev_ts));
+		clock::time_point t1 = clock::now();
+		sync_host_us = (hostUs(t0) + hostUs(t1)) / 2.0;
+		sync_dev_ticks = dev_ts;
+	}
+
+	ZeTracer(const ZeTracer &) = delete;
+	ZeTracer &operator=(const ZeTracer &) = delete;
+
+	~ZeTracer()
+	{
+		close();
+	}
+
+	// write the trace and release the event pools, must run before the
+	// context is destroyed
+	void close()
+	{
+		if (!on)
+			return;
+		write();
+		for (auto hEvent : all_events)
+			zeEventDestroy(hEvent);
+		for (auto hPool : pools)
+			zeEventPoolDestroy(hPool);
+		all_events.clear();
+		pools.clear();
+		on = false;
+	}
+
+	bool enabled() const
+	{
+		return on;
+	}
+
+	ze_result_t appendLaunchKernel(ze_command_list_handle_t list, ze_kernel_handle_t kernel,
+				       const ze_group_count_t *groupCount, ze_event_handle_t signal,
+				       uint32_t nwait, ze_event_handle_t *wait, const char *name)
+	{
+		if (!on)
+			return zeCommandListAppendLaunchKernel(list, kernel, groupCount, signal, nwait,
+							       wait);
+		return zeCommandListAppendLaunchKernel(list, kernel, groupCount,
+						       begin(list, signal, name, "kernel"), nwait,
+						       wait);
+	}
+
+	ze_result_t appendMemoryCopy(ze_command_list_handle_t list, void *dst, const void *src,
+				     size_t size, ze_event_handle_t signal, uint32_t nwait,
+				     ze_event_handle_t *wait, const char *name = "copy")
+	{
+		if (!on)
+			return zeCommandListAppendMemoryCopy(list, dst, src, size, signal, nwait, wait);
+		return zeCommandListAppendMemoryCopy(list, dst, src, size,
+						     begin(list, signal, name, "copy"), nwait, wait);
+	}
+
+	ze_result_t appendImageCopyFromMemory(ze_command_list_handle_t list, ze_image_handle_t image,
+					      const void *src, const ze_image_region_t *region,
+					      ze_event_handle_t signal, uint32_t nwait,
+					      ze_event_handle_t *wait, const char *name = "image upload")
+	{
+		if (!on)
+			return zeCommandListAppendImageCopyFromMemory(list, image, src, region, signal,
+								      nwait, wait);
+		return zeCommandListAppendImageCopyFromMemory(list, image, src, region,
+							      begin(list, signal, name, "copy"),
+							      nwait, wait);
+	}
+
+	ze_result_t appendImageCopyToMemory(ze_command_list_handle_t list, void *dst,
+					    ze_image_handle_t image, const ze_image_region_t *region,
+					    ze_event_handle_t signal, uint32_t nwait,
+					    ze_event_handle_t *wait, const char *name = "image readback")
+	{
+		if (!on)
+			return zeCommandListAppendImageCopyToMemory(list, dst, image, region, signal,
+								    nwait, wait);
+		return zeCommandListAppendImageCopyToMemory(list, dst, image, region,
+							    begin(list, signal, name, "copy"), nwait,
+							    wait);
+	}
+
+	ze_result_t appendBarrier(ze_command_list_handle_t list, ze_event_handle_t signal,
+				  uint32_t nwait, ze_event_handle_t *wait)
+	{
+		if (!on)
+			return zeCommandListAppendBarrier(list, signal, nwait, wait);
+		return zeCommandListAppendBarrier(list, begin(list, signal, "barrier", "barrier"),
+						  nwait, wait);
+	}
+
+	// zeEventHostSynchronize that also records the wait on the host track
+	// and reads back commands that signal the caller's own event, before
+	// the caller gets a chance to reset it. Managed events that are done by
+	// now go back to the pool as well, so a long run that never calls
+	// collect() does not keep allocating them.
+	ze_result_t hostSynchronize(ze_event_handle_t hEvent, uint64_t timeout)
+	{
+		if (!on)
+			return zeEventHostSynchronize(hEvent, timeout);
+
+		clock::time_point t0 = clock::now();
+		ze_result_t res = zeEventHostSynchronize(hEvent, timeout);
+		clock::time_point t1 = clock::now();
+		hostSpan("event sync", t0, t1);
+		if (res != ZE_RESULT_SUCCESS)
+			return res;
+
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto it = pending.begin(); it != pending.end();) {
+			if (it->event == hEvent ||
+			    (!it->borrowed && zeEventQueryStatus(it->event) == ZE_RESULT_SUCCESS)) {
+				harvest(*it);
+				it = pending.erase(it);
+			} else {
+				++it;
+			}
+		}
+		return res;
+	}
+
+	void hostSpan(const char *name, clock::time_point begin, clock::time_point end)
+	{
+		if (!on)
+			return;
+		std::lock_guard<std::mutex> guard(lock);
+		records.push_back({ name, "host", 0, threadId(), hostUs(begin),
+				    hostUs(end) - hostUs(begin) });
+	}
+
+	// wait for all commands issued so far and move them to the timeline,
+	// their events go back to the pool
+	void collect()
+	{
+		if (!on)
+			return;
+		std::lock_guard<std::mutex> guard(lock);
+		for (auto &p : pending) {
+			/* the owner may have reset a borrowed event already */
+			if (p.borrowed) {
+				if (zeEventQueryStatus(p.event) == ZE_RESULT_SUCCESS)
+					harvest(p);
+				continue;
+			}
+			if (zeEventHostSynchronize(p.event, ZE_TRACE_TIMEOUT) == ZE_RESULT_SUCCESS)
+				harvest(p);
+		}
+		pending.clear();
+	}
+
+	void write()
+	{
+		if (!on)
+			return;
+		collect();
+
+		FILE *fp = fopen(path.c_str(), "w");
+		if (fp == nullptr) {
+			fprintf(stderr, "FAIL: unable to open trace file %s\n", path.c_str());
+			return;
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		fprintf(fp, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+		fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,"
+			    "\"args\":{\"name\":\"host\"}},\n");
+		fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+			    "\"args\":{\"name\":\"");
+		escape(fp, props.name);
+		fprintf(fp, "\"}}");
+		for (auto &t : tracks)
+			fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,"
+				    "\"args\":{\"name\":\"command list %d\"}}",
+				t.second, t.second);
+		for (auto &r : records) {
+			fprintf(fp, ",\n{\"name\":\"");
+			escape(fp, r.name);
+			fprintf(fp, "\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+				    "\"ts\":%.3f,\"dur\":%.3f}",
+				r.cat, r.pid, r.tid, r.ts, r.dur);
+		}
+		fprintf(fp, "\n]}\n");
+		fclose(fp);
+
+		fprintf(stderr, "INFO: %zu trace events written to %s\n", records.size(),
+			path.c_str());
+	}
+};
+
+// host span from construction to end() or destruction
+class ZeTraceScope {
+	ZeTracer &tracer;
+	const char *name;
+	bool open;
+	std::chrono::steady_clock::time_point begin;
+
+    public:
+	ZeTraceScope(ZeTracer &tracer, const char *name)
+		: tracer(tracer)
+		, name(name)
+		, open(tracer.enabled())
+	{
+		if (open)
+			begin = std::chrono::steady_clock::now();
+	}
+
+	~ZeTraceScope()
+	{
+		end();
+	}
+
+	void end()
+	{
+		if (!open)
+			return;
+		tracer.hostSpan(name, begin, std::chrono::steady_clock::now());
+		open = false;
+	}
+};
+
+#endif
@@ -0,0 +1,330 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#ifndef ZE_TUNE_H
+#define ZE_TUNE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "ze_check.h"
+
+// Launch geometry and kernel variant autotuner with an on-disk database.
+//
+// An operation ("sgemm", "sgemv_n", ...) is given as a list of variants,
+// the kernels that compute it (usually compile-time tile variants) with
+// their arguments already set and the number of threads each one needs.
+// select() looks the operation up in the database under the device, the
+// driver version and the shape bucket (every dimension rounded up to a
+// power of two). On a miss it times every variant with every power of two
+// group size that divides its thread grid on the caller's immediate command
+// list, stores the fastest and returns it with the group size already set
+// on the winning kernel.
+//
+// Tuning launches the kernels, so the output buffers of the operation hold
+// garbage afterwards. The database is a text file, ZE_TUNE_DB names it
+// (default ze_tune.db in the working directory). ZE_TUNE=0 never tunes and
+// falls back to the first variant with 1x1x1 groups, ZE_TUNE=force tunes
+// even when the database has an entry.
+
+#define ZE_TUNE_ITERATIONS 5
+/* CM group sizes are in hardware threads, larger groups only add occupancy limits */
+#define ZE_TUNE_MAX_GROUP 64
+
+struct ze_tune_variant {
+	const char *name;
+	ze_kernel_handle_t kernel;
+	uint32_t threads[3];
+};
+
+struct ze_tune_result {
+	int variant; /* index into the variants given to select() */
+	uint32_t group[3];
+	ze_group_count_t count;
+	double ns; /* tuned kernel time, 0 for a fallback */
+};
+
+class ZeTuner {
+	struct Entry {
+		std::string variant;
+		uint32_t group[3];
+		double ns;
+	};
+
+	std::string path;
+	std::string device_key;
+	ze_context_handle_t context;
+	ze_device_handle_t device;
+	ze_device_properties_t props;
+	ze_device_compute_properties_t compute;
+	ze_event_pool_handle_t pool;
+	ze_event_handle_t event;
+	std::map<std::string, Entry> db;
+
+	void load()
+	{
+		FILE *fp = fopen(path.c_str(), "r");
+		if (fp == nullptr)
+			return;
+
+		char line[512], dev[128], op[128], bucket[128], variant[128];
+		Entry e;
+		while (fgets(line, sizeof(line), fp) != nullptr) {
+			if (line[0] == '#')
+				continue;
+			if (sscanf(line, "%127s %127s %127s %127s %u %u %u %lf", dev, op, bucket,
+				   variant, &e.group[0], &e.group[1], &e.group[2], &e.ns) != 8)
+				continue;
+			e.variant = variant;
+			db[key(dev, op, bucket)] = e;
+		}
+		fclose(fp);
+	}
+
+	/* the whole file is rewritten, other devices' entries are kept */
+	void save()
+	{
+		std::string tmp = path + ".tmp";
+		FILE *fp = fopen(tmp.c_str(), "w");
+		if (fp == nullptr) {
+			fprintf(stderr, "WARN: unable to write tuning database %s\n", path.c_str());
+			return;
+		}
+		fprintf(fp, "# device op shape variant group_x group_y group_z ns\n");
+		for (auto &it : db)
+			fprintf(fp, "%s %s %u %u %u %.1f\n", it.first.c_str(),
+				it.second.variant.c_str(), it.second.group[0], it.second.group[1],
+				it.second.group[2], it.second.ns);
+		fclose(fp);
+		if (rename(tmp.c_str(), path.c_str()) != 0)
+			fprintf(stderr, "WARN: unable to replace tuning database %s\n",
+				path.c_str());
+	}
+
+	static std::string key(const std::string &dev, const std::string &op,
+			       const std::string &bucket)
+	{
+		return dev + " " + op + " " + bucket;
+	}
+
+	static ze_group_count_t countFor(const uint32_t group[3], const uint32_t threads[3])
+	{
+		return { threads[0] / group[0], threads[1] / group[1], threads[2] / group[2] };
+	}
+
+	/* largest power of two <= limit that divides n */
+	static uint32_t pow2Divisor(uint32_t n, uint32_t limit)
+	{
+		uint32_t g = 1;
+		while (g * 2 <= limit && n % (g * 2) == 0)
+			g *= 2;
+		return g;
+	}
+
+	double timeNs()
+	{
+		ze_kernel_timestamp_result_t ts;
+		ZE_CHECK(zeEventQueryKernelTimestamp(event, &ts));
+
+		uint64_t mask = props.kernelTimestampValidBits >= 64 ?
+					~0ULL :
+					(1ULL << props.kernelTimestampValidBits) - 1;
+		uint64_t cycles = (ts.context.kernelEnd - ts.context.kernelStart) & mask;
+		/* timerResolution is in ns per cycle */
+		return cycles * (double)props.timerResolution;
+	}
+
+	/* best of iterations, or a negative value if the geometry is rejected */
+	double measure(ze_command_list_handle_t list, const ze_tune_variant &v,
+		       const uint32_t group[3], int iterations)
+	{
+		if (zeKernelSetGroupSize(v.kernel, group[0], group[1], group[2]) !=
+		    ZE_RESULT_SUCCESS)
+			return -1.0;
+
+		ze_group_count_t count = countFor(group, v.threads);
+		double best = std::numeric_limits<double>::max();
+		/* the first launch is a warm-up */
+		for (int i = 0; i <= iterations; i++) {
+			if (zeCommandListAppendLaunchKernel(list, v.kernel, &count, event, 0,
+							    nullptr) != ZE_RESULT_SUCCESS)
+				return -1.0;
+			ZE_CHECK(zeEventHostSynchronize(event,
+							std::numeric_limits<uint64_t>::max()));
+			if (i > 0)
+				best = std::min(best, timeNs());
+			ZE_CHECK(zeEventHostReset(event));
+		}
+		return best;
+	}
+
+    public:
+	ZeTuner(ze_driver_handle_t driver, ze_device_handle_t device, ze_context_handle_t context,
+		const char *db_path = getenv("ZE_TUNE_DB"))
+		: path(db_path != nullptr && db_path[0] != '\0' ? db_path : "ze_tune.db")
+		, context(context)
+		, device(device)
+		, pool(nullptr)
+		, event(nullptr)
+	{
+		ze_driver_properties_t driver_props = { ZE_STRUCTURE_TYPE_DRIVER_PROPERTIES };
+		ZE_CHECK(zeDriverGetProperties(driver, &driver_props));
+		props = { ZE_STRUCTURE_TYPE_DEVICE_PROPERTIES };
+		ZE_CHECK(zeDeviceGetProperties(device, &props));
+		compute = { ZE_STRUCTURE_TYPE_DEVICE_COMPUTE_PROPERTIES };
+		ZE_CHECK(zeDeviceGetComputeProperties(device, &compute));
+
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%04x:%04x:%08x", props.vendorId, props.deviceId,
+			 driver_props.driverVersion);
+		device_key = buf;
+		load();
+	}
+
+	~ZeTuner()
+	{
+		close();
+	}
+
+	ZeTuner(const ZeTuner &) = delete;
+	ZeTuner &operator=(const ZeTuner &) = delete;
+
+	// releases the timing event, must be called before the context is
+	// destroyed
+	void close()
+	{
+		if (event != nullptr)
+			ZE_CHECK(zeEventDestroy(event));
+		if (pool != nullptr)
+			ZE_CHECK(zeEventPoolDestroy(pool));
+		event = nullptr;
+		pool = nullptr;
+	}
+
+	static std::string shapeBucket(const std::vector<uint32_t> &shape)
+	{
+		std::string s;
+		for (uint32_t d : shape) {
+			uint32_t b = 1;
+			while (b < d)
+				b <<= 1;
+			s += (s.empty() ? "" : "x") + std::to_string(b);
+		}
+		return s;
+	}
+
+	// times every variant and group size on the immediate command list
+	// and stores the winner
+	ze_tune_result tune(ze_command_list_handle_t list, const std::string &op,
+			    const std::vector<uint32_t> &shape,
+			    const std::vector<ze_tune_variant> &variants,
+			    int iterations = ZE_TUNE_ITERATIONS)
+	{
+		if (pool == nullptr) {
+			ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC,
+							   nullptr, 0, 1 };
+			pool_desc.flags = ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP |
+					  ZE_EVENT_POOL_FLAG_HOST_VISIBLE;
+			ZE_CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &pool));
+			ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, 0,
+						 ZE_EVENT_SCOPE_FLAG_HOST,
+						 ZE_EVENT_SCOPE_FLAG_HOST };
+			ZE_CHECK(zeEventCreate(pool, &desc, &event));
+		}
+
+		uint32_t max_x = std::min<uint32_t>(compute.maxGroupSizeX, ZE_TUNE_MAX_GROUP);
+		uint32_t max_y = std::min<uint32_t>(compute.maxGroupSizeY, ZE_TUNE_MAX_GROUP);
+		uint32_t max_total =
+			std::min<uint32_t>(compute.maxTotalGroupSize, ZE_TUNE_MAX_GROUP);
+
+		ze_tune_result best = { -1, { 1, 1, 1 }, { 0, 0, 0 },
+					std::numeric_limits<double>::max() };
+		for (size_t v = 0; v < variants.size(); v++) {
+			const ze_tune_variant &var = variants[v];
+			for (uint32_t gy = 1; gy <= max_y && var.threads[1] % gy == 0; gy *= 2)
+				for (uint32_t gx = 1; gx <= max_x && var.threads[0] % gx == 0;
+				     gx *= 2) {
+					if (gx * gy > max_total)
+						break;
+					uint32_t group[3] = { gx, gy, 1 };
+					double ns = measure(list, var, group, iterations);
+					if (ns < 0.0 || ns >= best.ns)
+						continue;
+					best = { (int)v, { gx, gy, 1 },
+						 countFor(group, var.threads), ns };
+				}
+		}
+		if (best.variant < 0) {
+			fprintf(stderr, "FAIL: no launchable variant of %s\n", op.c_str());
+			exit(-1);
+		}
+
+		const ze_tune_variant &win = variants[best.variant];
+		printf("tune: %s %s -> %s group %ux%ux%u, %.3f us\n", op.c_str(),
+		       shapeBucket(shape).c_str(), win.name, best.group[0], best.group[1],
+		       best.group[2], best.ns / 1000.0);
+
+		db[key(device_key, op, shapeBucket(shape))] = {
+			win.name, { best.group[0], best.group[1], best.group[2] }, best.ns
+		};
+		save();
+
+		ZE_CHECK(zeKernelSetGroupSize(win.kernel, best.group[0], best.group[1],
+					      best.group[2]));
+		return best;
+	}
+
+	// database lookup, tuning on a miss; the group size of the returned
+	// variant's kernel is set
+	ze_tune_result select(ze_command_list_handle_t list, const std::string &op,
+			      const std::vector<uint32_t> &shape,
+			      const std::vector<ze_tune_variant> &variants)
+	{
+		const char *mode = getenv("ZE_TUNE");
+		bool force = mode != nullptr && strcmp(mode, "force") == 0;
+		bool off = mode != nullptr && strcmp(mode, "0") == 0;
+
+		auto it = db.find(key(device_key, op, shapeBucket(shape)));
+		if (it != db.end() && !force) {
+			for (size_t v = 0; v < variants.size(); v++) {
+				if (it->second.variant != variants[v].name)
+					continue;
+				/* the bucket covers shapes the stored group may not divide */
+				const uint32_t *threads = variants[v].threads;
+				const uint32_t *group = it->second.group;
+				ze_tune_result res;
+				res.variant = (int)v;
+				for (int i = 0; i < 3; i++)
+					res.group[i] = pow2Divisor(threads[i], group[i]);
+				res.count = countFor(res.group, threads);
+				res.ns = it->second.ns;
+				ZE_CHECK(zeKernelSetGroupSize(variants[v].kernel, res.group[0],
+							      res.group[1], res.group[2]));
+				return res;
+			}
+		}
+
+		if (off) {
+			uint32_t group[3] = { 1, 1, 1 };
+			ZE_CHECK(zeKernelSetGroupSize(variants[0].kernel, 1, 1, 1));
+			return { 0, { 1, 1, 1 }, countFor(group, variants[0].threads), 0.0 };
+		}
+		return tune(list, op, shape, variants);
+	}
+};
+
+#endif
@@ -20,6 +20,9 @@ SPDX-License-Identifier: MIT
 
 #include <level_zero/ze_api.h>
 
+#include "cm_trace_host.h"
+#include "ze_trace.h"
+
 #define SZ 160
 #define KERNEL_SZ 16
 #define CHECK(a)                                                              \
@@ -107,6 +110,9 @@ int main(int argc, char *argv[])
 					  nullptr, 0 };
 	CHECK(zeContextCreate(driver, &contextDesc, &context));
 
+	// timeline of the run when ZE_TRACE=<file.json> is set
+	ZeTracer tracer(context, device);
+
 	// create a command queue and list
 	ze_command_queue_desc_t commandQueueDesc = {
 		ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
@@ -125,6 +131,7 @@ int main(int argc, char *argv[])
 				  &commands));
 
 	// read in and initialize kernel
+	ZeTraceScope moduleScope(tracer, "module build");
 	FILE *fp = fopen(KERNEL, "rb");
 	if (fp == nullptr) {
 		fprintf(stderr, "FAIL: unable to open %s\n", KERNEL);
@@ -150,6 +157,7 @@ int main(int argc, char *argv[])
 	ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr,
 					0, "vector_add" };
 	CHECK(zeKernelCreate(module, &kernelDesc, &kernel));
+	moduleScope.end();
 
 	size_t bytes = SZ * sizeof(int);
 	ze_device_mem_alloc_desc_t deviceMemDesc = {
@@ -157,6 +165,7 @@ int main(int argc, char *argv[])
 	};
 
 	// kernel parameter initialization
+	ZeTraceScope allocScope(tracer, "allocation");
 	void *d_a = nullptr, *d_b = nullptr, *d_c = nullptr;
 	CHECK(zeMemAllocDevice(context, &deviceMemDesc, /*size*/ bytes,
 			       /*align*/ 64, device, &d_a));
@@ -164,33 +173,52 @@ int main(int argc, char *argv[])
 			       &d_b));
 	CHECK(zeMemAllocDevice(context, &deviceMemDesc, bytes, 64, device,
 			       &d_c));
+	CmTraceBuffer trace(context, device);
+	void *d_trace = trace.data();
+	allocScope.end();
 
-	CHECK(zeCommandListAppendMemoryCopy(commands, d_a, src1, bytes, nullptr,
-					    0, nullptr));
-	CHECK(zeCommandListAppendMemoryCopy(commands, d_b, src2, bytes, nullptr,
-					    0, nullptr));
-	CHECK(zeCommandListAppendBarrier(commands, nullptr, 0, nullptr));
+	CHECK(tracer.appendMemoryCopy(commands, d_a, src1, bytes, nullptr, 0,
+				      nullptr, "copy src1"));
+	CHECK(tracer.appendMemoryCopy(commands, d_b, src2, bytes, nullptr, 0,
+				      nullptr, "copy src2"));
+	CHECK(tracer.appendBarrier(commands, nullptr, 0, nullptr));
 
 	CHECK(zeKernelSetArgumentValue(kernel, 0, sizeof(d_a), &d_a));
 	CHECK(zeKernelSetArgumentValue(kernel, 1, sizeof(d_b), &d_b));
 	CHECK(zeKernelSetArgumentValue(kernel, 2, sizeof(d_c), &d_c));
+	CHECK(zeKernelSetArgumentValue(kernel, 3, sizeof(d_trace), &d_trace));
 
-	// set group size - single KERNEL_SZ size entry per group
-	CHECK(zeKernelSetGroupSize(kernel, /*x*/ 2, /*y*/ 2, /*z*/ 1));
+	// one thread per KERNEL_SZ entries, the driver picks the group size
+	uint32_t threads = SZ / KERNEL_SZ;
+	uint32_t group_x = 1, group_y = 1, group_z = 1;
+	CHECK(zeKernelSuggestGroupSize(kernel, threads, 1, 1, &group_x,
+				       &group_y, &group_z));
+	if (threads % group_x != 0)
+		group_x = 1;
+	CHECK(zeKernelSetGroupSize(kernel, group_x, 1, 1));
 
 	// launch - data split across multiple groups
-	ze_group_count_t groupCount = { SZ / KERNEL_SZ, 1, 1 };
-	CHECK(zeCommandListAppendLaunchKernel(commands, kernel, &groupCount,
-					      nullptr, 0, nullptr));
+	ze_group_count_t groupCount = { threads / group_x, 1, 1 };
+	CHECK(tracer.appendLaunchKernel(commands, kernel, &groupCount, nullptr,
+					0, nullptr, "vector_add"));
 
-	CHECK(zeCommandListAppendBarrier(commands, nullptr, 0, nullptr));
+	CHECK(tracer.appendBarrier(commands, nullptr, 0, nullptr));
 	// copy result to host
-	CHECK(zeCommandListAppendMemoryCopy(commands, dst, d_c, bytes, nullptr,
-					    0, nullptr));
+	CHECK(tracer.appendMemoryCopy(commands, dst, d_c, bytes, nullptr, 0,
+				      nullptr, "copy dst"));
 
 	// send to GPU
 	CHECK(zeCommandListClose(commands));
+	ZeTraceScope execScope(tracer, "execute");
 	CHECK(zeCommandQueueExecuteCommandLists(queue, 1, &commands, nullptr));
+	execScope.end();
+	tracer.collect();
+
+	// per thread records of the kernel, CM_TRACE_CSV=<file> exports them
+	trace.print(stdout);
+	if (getenv("CM_TRACE_CSV"))
+		trace.writeCsv(getenv("CM_TRACE_CSV"));
+	trace.close();
 
 	// process output and cleanup
 	CHECK(zeMemFree(context, d_a));
@@ -198,6 +226,7 @@ int main(int argc, char *argv[])
 	CHECK(zeMemFree(context, d_c));
 
 	// verify results
+	ZeTraceScope verifyScope(tracer, "verification");
 	for (unsigned i = 0; i < SZ; i++)
 		if ((src1[i] + src2[i]) != dst[i]) {
 			fprintf(stderr,
@@ -206,6 +235,8 @@ int main(int argc, char *argv[])
 				dst[i]);
 			exit(-1);
 		}
+	verifyScope.end();
+	tracer.close();
 	fprintf(stderr, "PASSED\n");
 	return 0;
 }
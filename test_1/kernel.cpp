@@ -8,13 +8,15 @@ SPDX-License-Identifier: MIT
 
 #include <cm/cm.h>
 
+#include "cm_trace.h"
+
 #ifdef SHIM
 #include "shim_support.h"
 #else
 #define SHIM_API_EXPORT
 #endif
 extern "C" SHIM_API_EXPORT void vector_add(SurfaceIndex, SurfaceIndex,
-					   SurfaceIndex);
+					   SurfaceIndex, SurfaceIndex);
 
 // shim layer (CM kernel, OpenCL runtime, GPU)
 #ifdef SHIM
@@ -34,18 +36,21 @@ _GENX_MAIN_
 #endif
 void vector_add(SurfaceIndex isurface1 SURFACE_TYPE,
 		SurfaceIndex isurface2 SURFACE_TYPE,
-		SurfaceIndex osurface SURFACE_TYPE)
+		SurfaceIndex osurface SURFACE_TYPE,
+		SurfaceIndex trace SURFACE_TYPE)
 
 {
 	vector<int, SZ> ivector1;
 	vector<int, SZ> ivector2;
 	vector<int, SZ> ovector;
 
-	printf("group_count(0)=%d, group_count(1)=%d local_size(0)=%d local_size(1)=%d gid(0)=%d, gid(1)=%d, lid(0)=%d, lid(1)=%d, cm_linear_global_id=%d\n",
-	       cm_group_count(0), cm_group_count(1), cm_local_size(0),
-	       cm_local_size(1), cm_group_id(0), cm_group_id(1), cm_local_id(0),
-	       cm_local_id(1), cm_linear_global_id());
-	unsigned offset = sizeof(unsigned) * SZ * cm_group_id(0);
+	// one SZ chunk per thread, whatever the group size is
+	unsigned offset = sizeof(unsigned) * SZ *
+			  (cm_group_id(0) * cm_local_size(0) + cm_local_id(0));
+	// ids and timestamp are part of every record
+	CM_TRACE(CM_TRACE_INFO, trace, CM_TRACE_TAG('v', 'a', 'd', 'd'),
+		 cm_group_count(0), cm_group_count(1), cm_local_size(0),
+		 cm_local_size(1), offset);
 	//
 	// read-in the arguments
 	read(isurface1, offset, ivector1);
@@ -20,6 +20,9 @@ SPDX-License-Identifier: MIT
 
 #include <level_zero/ze_api.h>
 
+#include "cm_trace_host.h"
+#include "ze_trace.h"
+
 #define SZ 160
 #define KERNEL_SZ 16
 #define CHECK(a) do { \
@@ -93,6 +96,9 @@ int main(int argc, char* argv[])
 					  nullptr, 0 };
 	CHECK(zeContextCreate(driver, &contextDesc, &context));
 
+	// timeline of the run when ZE_TRACE=<file.json> is set
+	ZeTracer tracer(context, device);
+
 	// create a command queue and list
 	ze_command_queue_desc_t commandQueueDesc = {
 		ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
@@ -111,6 +117,7 @@ int main(int argc, char* argv[])
 				  &commands));
 
 	// read in and initialize kernel
+	ZeTraceScope moduleScope(tracer, "module build");
 	FILE *fp = fopen(KERNEL, "rb");
 	if (fp == nullptr) {
 		fprintf(stderr, "FAIL: unable to open %s\n", KERNEL);
@@ -136,39 +143,53 @@ int main(int argc, char* argv[])
 	ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr,
 					0, "hello_world" };
 	CHECK(zeKernelCreate(module, &kernelDesc, &kernel));
+	moduleScope.end();
 
+	// one thread per x position, the suggestion is a group size for that
+	// grid, the group count follows from it
+	int threadwidth = 8;
 	uint32_t suggested_group_size_x, suggested_group_size_y,
 		suggested_group_size_z;
-	zeKernelSuggestGroupSize(kernel, 0, 0, 0, &suggested_group_size_x,
-				 &suggested_group_size_y,
-				 &suggested_group_size_z);
+	CHECK(zeKernelSuggestGroupSize(kernel, threadwidth, 1, 1,
+				       &suggested_group_size_x,
+				       &suggested_group_size_y,
+				       &suggested_group_size_z));
+	if (threadwidth % suggested_group_size_x != 0)
+		suggested_group_size_x = 1;
 	printf("suggested_group_size_x=%u, suggested_group_size_y=%u, suggested_group_size_z=%u\n",
 	       suggested_group_size_x, suggested_group_size_y,
 	       suggested_group_size_z);
-	int threadwidth = 8;
 	CHECK(zeKernelSetArgumentValue(kernel, 0, sizeof(int), &threadwidth));
 
-	// set group size - single KERNEL_SZ size entry per group
-	// CHECK(zeKernelSetGroupSize(kernel, /*x*/ 1, /*y*/ 1, /*z*/ 1));
-	// CHECK(zeKernelSetGroupSize(kernel,
-	// 			   /*x*/ suggested_group_size_x,
-	// 			   /*y*/ suggested_group_size_y,
-	// 			   /*z*/ suggested_group_size_z));
+	CmTraceBuffer trace(context, device);
+	trace.setFormat(CM_TRACE_TAG('h', 'e', 'l', 'o'),
+			"%u   Hello from GPU land. x=%u, y=%u, threadwidth=%u");
+	void *d_trace = trace.data();
+	CHECK(zeKernelSetArgumentValue(kernel, 1, sizeof(d_trace), &d_trace));
 
-	// launch - data split across multiple groups
-	// ze_group_count_t groupCount = { 8, 1, 1 };
+	CHECK(zeKernelSetGroupSize(kernel, suggested_group_size_x, 1, 1));
 
-	ze_group_count_t groupCount = { suggested_group_size_x,
-					suggested_group_size_y,
-					suggested_group_size_z };
-	CHECK(zeCommandListAppendLaunchKernel(commands, kernel, &groupCount,
-					      nullptr, 0, nullptr));
+	// launch - threadwidth threads split across groups
+	ze_group_count_t groupCount = {
+		threadwidth / suggested_group_size_x, 1, 1
+	};
+	CHECK(tracer.appendLaunchKernel(commands, kernel, &groupCount, nullptr,
+					0, nullptr, "hello_world"));
 
-	CHECK(zeCommandListAppendBarrier(commands, nullptr, 0, nullptr));
+	CHECK(tracer.appendBarrier(commands, nullptr, 0, nullptr));
 
 	// send to GPU
 	CHECK(zeCommandListClose(commands));
+	ZeTraceScope execScope(tracer, "execute");
 	CHECK(zeCommandQueueExecuteCommandLists(queue, 1, &commands, nullptr));
+	execScope.end();
+
+	// per thread records of the kernel, CM_TRACE_CSV=<file> exports them
+	trace.print(stdout);
+	if (getenv("CM_TRACE_CSV"))
+		trace.writeCsv(getenv("CM_TRACE_CSV"));
+	trace.close();
+	tracer.close();
 
 	fprintf(stderr, "PASSED\n");
 	return 0;
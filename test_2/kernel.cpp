@@ -22,16 +22,19 @@
 
 #include "cm/cm.h"
 
-extern "C" _GENX_MAIN_ void hello_world(int threadwidth) {
+#include "cm_trace.h"
 
-    // Gets the x,y coordinates
-    unsigned int x = get_thread_origin_x();
-    unsigned int y = get_thread_origin_y();
+extern "C" _GENX_MAIN_ void hello_world(int threadwidth,
+					SurfaceIndex trace [[type("buffer_t")]]) {
+
+    // Gets the x,y coordinates in the launch grid, any group size
+    unsigned int x = cm_group_id(0) * cm_local_size(0) + cm_local_id(0);
+    unsigned int y = cm_group_id(1) * cm_local_size(1) + cm_local_id(1);
 
     // Converts the x,y coordinates to a linearized thread ID
     unsigned int threadid = x + y*threadwidth;
 
-    // Prints the thread ID along with a string message
-    printf("%u   Hello from GPU land. x=%u, y=%u, threadwidth=%u\n", threadid,
-	   x, y, threadwidth);
+    // Records the thread ID, the host prints the message
+    CM_TRACE(CM_TRACE_INFO, trace, CM_TRACE_TAG('h', 'e', 'l', 'o'), threadid,
+	     x, y, threadwidth);
 }
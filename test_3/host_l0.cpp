@@ -18,8 +18,15 @@ SPDX-License-Identifier: MIT
 #include <cstring>
 #include <limits>
 
+#include <unistd.h>
+
 #include <level_zero/ze_api.h>
 
+#include "matrix_file.h"
+#include "ze_spec.h"
+#include "ze_trace.h"
+#include "ze_tune.h"
+
 #include <gsl/gsl_cblas.h>
 #include <algorithm>
 
@@ -54,6 +61,19 @@ using namespace std;
 #define __ALIGN_KERNEL(x, a) __ALIGN_KERNEL_MASK(x, (typeof(x))(a)-1)
 #define ALIGN(x, a) __ALIGN_KERNEL((x), (a))
 
+/* rows of C per sgemv_kernel_n thread, columns per sgemv_kernel_t thread */
+#define GEMV_ROWS 16
+#define GEMV_COLS 16
+
+/* columns of C per sgemm_splitk thread */
+#define SPLITK_COLS 16
+/* k split when it is SPLITK_RATIO times m and n and the grid is too small */
+#define SPLITK_RATIO 16
+/* target sgemm_splitk threads per hardware thread */
+#define SPLITK_OCCUPANCY 4
+/* smallest k range of one split */
+#define SPLITK_MIN_CHUNK 1024
+
 static float randData(float low, float high)
 {
 	float t = (float)rand() / (float)RAND_MAX;
@@ -66,32 +86,55 @@ class Matrix {
 	uint32_t nrows_aligned;
 	uint32_t ncols;
 	uint32_t ncols_aligned;
+	MatrixFile file;
 
     public:
 	float &operator()(int r, int c)
 	{
-		return M[r * ncols_aligned + c];
+		return M[(size_t)r * ncols_aligned + c];
 	}
 
-	Matrix(uint32_t rows, uint32_t cols, bool init)
+	// with path the matrix is the matrix file at path, mapped without a
+	// copy; when there is no file there yet the new matrix is saved to it
+	Matrix(uint32_t rows, uint32_t cols, bool init, const char *path = nullptr)
 	{
 		this->nrows = rows;
 		this->nrows_aligned = ALIGN(this->nrows, KERNEL_ALIGN);
 		this->ncols = cols;
 		this->ncols_aligned = ALIGN(this->ncols, KERNEL_ALIGN);
 
+		if (path != nullptr && access(path, F_OK) == 0) {
+			CHECK2(!file.open(path), path);
+			CHECK2(file.rows() != rows || file.cols() != cols, "matrix file shape");
+			/* file rows are padded to MATRIX_FILE_LD_ALIGN with zeros as well */
+			static_assert(MATRIX_FILE_LD_ALIGN % KERNEL_ALIGN == 0, "ld alignment");
+			this->ncols_aligned = file.ld();
+			M = file.data();
+			return;
+		}
+
 		size_t size = sizeof(float) * this->nrows_aligned * this->ncols_aligned;
 
 		M = (float *)aligned_alloc(4096, size);
+		/* kernels walk k in steps of 16, padding must not add to the sum */
+		memset(M, 0, size);
 
 		if (init)
 			for (int i = 0; i < rows; i++)
 				for (int j = 0; j < cols; j++)
 					(*this)(i, j) = randData(0.0f, 1.0f);
+		if (path != nullptr)
+			CHECK2(!save(path), path);
 	}
 
 #define CORRECTNESS_THRESHOLD 0.00002
 	bool operator==(Matrix &m)
+	{
+		return near(m, CORRECTNESS_THRESHOLD);
+	}
+
+	// every element within a relative error of threshold of m
+	bool near(Matrix &m, double threshold)
 	{
 		double max_relerror = 0.0;
 		double max_abserror = 0.0;
@@ -106,14 +149,14 @@ class Matrix {
 				max_relerror = max(max_relerror, relerror);
 				max_abserror = max(max_abserror, abserror);
 
-				if (relerror > CORRECTNESS_THRESHOLD) {
+				if (relerror > threshold) {
 					printf("Failure %f %f relerror: %lf at [%d, %d]\n",
 					       (*this)(r, c), m(r, c), relerror, r, c);
 					return false;
 				}
 			}
 		printf("max_relerror = %e  absolute error = %e\n", max_relerror, max_abserror);
-		return (max_relerror > CORRECTNESS_THRESHOLD) ? false : true;
+		return (max_relerror > threshold) ? false : true;
 		return true;
 	}
 
@@ -131,6 +174,7 @@ class Matrix {
 		size_t size = sizeof(float) * this->nrows_aligned * this->ncols_aligned;
 
 		M = (float *)aligned_alloc(4096, size);
+		memset(M, 0, size);
 		for (int i = 0; i < nrows; i++) {
 			for (int j = 0; j < ncols; j++)
 				(*this)(i, j) = m(i, j);
@@ -143,7 +187,7 @@ class Matrix {
 	};
 	uint32_t cols()
 	{
-		return nrows;
+		return ncols;
 	};
 	uint32_t ld()
 	{
@@ -154,9 +198,16 @@ class Matrix {
 		return M;
 	}
 
+	bool save(const char *path)
+	{
+		return MatrixFile::write(path, M, nrows, ncols, ncols_aligned);
+	}
+
 	~Matrix()
 	{
-		free(M);
+		/* a mapped matrix is unmapped by file */
+		if (file.data() == nullptr)
+			free(M);
 	}
 };
 
@@ -176,27 +227,119 @@ static int sgemmNxN(int m, int n, int k, float alpha, float *A, int lda, float *
 	return 0;
 }
 
-int main(int argc, char *argv[])
+// C := alpha*A*B + beta*C accumulated in double, the reference for the GPU
+// result: a float sum of a long k is off by more than CORRECTNESS_THRESHOLD
+// on its own, whichever order it adds in
+static void sgemmRef(int m, int n, int k, float alpha, float *A, int lda, float *B, int ldb,
+		     float beta, float *C, int ldc)
 {
-	// uint32_t a_rows = 15, a_cols = 15;
-	// uint32_t b_rows = 15, b_cols = 15;
-	// uint32_t c_rows = 15, c_cols = 15;
-	//
-	uint32_t a_rows = 16, a_cols = 16;
-	uint32_t b_rows = 16, b_cols = 16;
-	uint32_t c_rows = 16, c_cols = 16;
+	for (int r = 0; r < m; r++)
+		for (int c = 0; c < n; c++) {
+			double tmp = 0.0;
+			for (int t = 0; t < k; t++)
+				tmp += (double)A[r * lda + t] * B[t * ldb + c];
+			C[r * ldc + c] = alpha * tmp + beta * (double)C[r * ldc + c];
+		}
+}
 
+// relative error the GPU result may have: the float rounding of a k long
+// sum grows with sqrt(k), the 16x16x16 threshold is the floor
+static double gpuThreshold(uint32_t k)
+{
+	double t = 8 * numeric_limits<float>::epsilon() * sqrt((double)k);
+	return max(t, (double)CORRECTNESS_THRESHOLD);
+}
+
+static double kernelTimeNs(ze_event_handle_t hEvent, ze_device_properties_t &props)
+{
+	ze_kernel_timestamp_result_t ts;
+	CHECK(zeEventQueryKernelTimestamp(hEvent, &ts));
+
+	uint64_t mask = props.kernelTimestampValidBits >= 64 ?
+				~0ULL :
+				(1ULL << props.kernelTimestampValidBits) - 1;
+	uint64_t cycles = (ts.context.kernelEnd - ts.context.kernelStart) & mask;
+	/* timerResolution is in ns per cycle */
+	return cycles * (double)props.timerResolution;
+}
+
+// rows and cols of the matrix file named by env, if there is one
+static bool fileShape(const char *env, uint32_t *rows, uint32_t *cols)
+{
+	const char *path = getenv(env);
+	uint64_t r, c;
+	if (path == nullptr || access(path, F_OK) != 0 || !MatrixFile::peek(path, &r, &c))
+		return false;
+	*rows = r;
+	*cols = c;
+	return true;
+}
+
+// number of k splits for an m x n x k sgemm, 0 when it is not split.
+// sgemm_kernel_am runs one thread per element of C with the whole k loop,
+// for a small C and a long k that leaves most of the device idle, so k is
+// split until every hardware thread has SPLITK_OCCUPANCY threads to run.
+// GEMM_SPLITK=0 never splits, GEMM_SPLITK=<s> always uses s splits.
+static uint32_t splitK(uint32_t m, uint32_t n, uint32_t k, ze_device_properties_t &props)
+{
+	const char *env = getenv("GEMM_SPLITK");
+	if (env != nullptr)
+		return atoi(env) > 1 ? atoi(env) : 0;
+	if ((uint64_t)k < SPLITK_RATIO * (uint64_t)max(m, n))
+		return 0;
+
+	uint64_t hw = (uint64_t)props.numThreadsPerEU * props.numEUsPerSubslice *
+		      props.numSubslicesPerSlice * props.numSlices;
+	uint64_t tiles = (uint64_t)ALIGN(n, SPLITK_COLS) / SPLITK_COLS * m;
+	uint64_t want = hw * SPLITK_OCCUPANCY;
+	if (tiles >= want)
+		return 0;
+	uint64_t splits = min((want + tiles - 1) / tiles, (uint64_t)k / SPLITK_MIN_CHUNK);
+	return splits > 1 ? splits : 0;
+}
+
+int main(int argc, char *argv[])
+{
+	// usage: main.l0.skl [m n k [iterations]]
+	// GEMM_A, GEMM_B and GEMM_C name matrix files (see matrix_file.h) the
+	// inputs are mapped from, the shape is then taken from the files;
+	// missing files are created with the random inputs. GEMM_OUT names the
+	// file the GPU result is written to.
+	uint32_t m = 16, n = 16, k = 16;
 	int nIterations = 1;
 
-	Matrix A_in(a_rows, a_cols, true);
-	Matrix B_in(b_rows, b_cols, true);
-	Matrix C_out(c_rows, c_cols, true);
+	if (argc > 3) {
+		m = atoi(argv[1]);
+		n = atoi(argv[2]);
+		k = atoi(argv[3]);
+	}
+	if (argc > 4)
+		nIterations = atoi(argv[4]);
+
+	bool a_file = fileShape("GEMM_A", &m, &k);
+	uint32_t b_k = k;
+	if (fileShape("GEMM_B", &b_k, &n)) {
+		k = a_file ? k : b_k;
+		CHECK2(b_k != k, "GEMM_A and GEMM_B do not match");
+	}
+
+	uint32_t a_rows = m, a_cols = k;
+	uint32_t b_rows = k, b_cols = n;
+	uint32_t c_rows = m, c_cols = n;
+
+	Matrix A_in(a_rows, a_cols, true, getenv("GEMM_A"));
+	Matrix B_in(b_rows, b_cols, true, getenv("GEMM_B"));
+	Matrix C_out(c_rows, c_cols, true, getenv("GEMM_C"));
 	Matrix C_out_gpu(C_out);
 	Matrix C_old(C_out);
 	Matrix C_test(C_out);
+	Matrix C_ref(C_out);
 
 	float alpha = +1.0, beta = +1.0;
 
+	sgemmRef(a_rows, b_cols, b_rows, alpha, A_in.data(), A_in.ld(), B_in.data(), B_in.ld(),
+		 beta, C_ref.data(), C_ref.ld());
+
 	sgemmNxN(a_rows, b_cols, b_rows, alpha, A_in.data(), A_in.ld(), B_in.data(), B_in.ld(),
 		 beta, C_out.data(), C_out.ld());
 	printf("sgemmNxN multiplication is done\n");
@@ -217,7 +360,6 @@ int main(int argc, char *argv[])
 	ze_context_handle_t context = nullptr;
 	ze_command_queue_handle_t queue;
 	ze_command_list_handle_t commands;
-	ze_module_handle_t module;
 	ze_kernel_handle_t kernel;
 
 	CHECK(zeInit(ZE_INIT_FLAG_GPU_ONLY));
@@ -259,10 +401,18 @@ int main(int argc, char *argv[])
 	CHECK2((driver == nullptr), "unable to locate driver with GPU device");
 	CHECK2((device == nullptr), "unable to locate GPU device");
 
+	ze_device_properties_t device_properties;
+	CHECK(zeDeviceGetProperties(device, &device_properties));
+
 	ze_context_desc_t contextDesc = { ZE_STRUCTURE_TYPE_CONTEXT_DESC,
 					  nullptr, 0 };
 	CHECK(zeContextCreate(driver, &contextDesc, &context));
 
+	// timeline of the run when ZE_TRACE=<file.json> is set
+	ZeTracer tracer(context, device);
+	// tuned variant and launch geometry per shape, see ze_tune.h
+	ZeTuner tuner(driver, device, context);
+
 	// create a command queue and list
 	ze_command_queue_desc_t commandQueueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
 						     nullptr,
@@ -275,9 +425,36 @@ int main(int argc, char *argv[])
 
 	CHECK(zeCommandListCreateImmediate(context, device, &commandQueueDesc, &commands));
 
+	/*
+	 * split-K reads A and B as buffers (a long k does not fit the image
+	 * size limits either) and sums the partial products of the splits
+	 * into C with sgemm_splitk_reduce
+	 */
+	uint32_t splits = (m > 1 && n > 1) ? splitK(m, n, k, device_properties) : 0;
+	uint32_t kchunk = 0;
+	if (splits > 0) {
+		kchunk = ALIGN((k + splits - 1) / splits, 8);
+		splits = (k + kchunk - 1) / kchunk;
+	}
+
+	ZeTraceScope allocScope(tracer, "allocation");
 	ze_image_format_t img_fmt = { ZE_IMAGE_FORMAT_LAYOUT_32,
 				      ZE_IMAGE_FORMAT_TYPE_FLOAT };
-	ze_image_handle_t hAImage;
+	ze_image_handle_t hAImage = nullptr;
+	ze_image_handle_t hBImage = nullptr;
+	void *d_a = nullptr, *d_b = nullptr, *d_p = nullptr;
+	size_t a_bytes = sizeof(float) * A_in.rows() * A_in.ld();
+	/* rows of B up to the k padding of A are zero */
+	size_t b_bytes = sizeof(float) * A_in.ld() * B_in.ld();
+	size_t b_used = sizeof(float) * B_in.rows() * B_in.ld();
+	if (splits > 0) {
+		ze_device_mem_alloc_desc_t memDesc = { ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC,
+						       nullptr, 0, 0 };
+		size_t p_bytes = sizeof(float) * splits * C_out_gpu.rows() * C_out_gpu.ld();
+		CHECK(zeMemAllocDevice(context, &memDesc, a_bytes, 64, device, &d_a));
+		CHECK(zeMemAllocDevice(context, &memDesc, b_bytes, 64, device, &d_b));
+		CHECK(zeMemAllocDevice(context, &memDesc, p_bytes, 64, device, &d_p));
+	}
 	ze_image_desc_t desc_A = { ZE_STRUCTURE_TYPE_IMAGE_DESC,
 				   nullptr,
 				   ZE_IMAGE_FLAG_KERNEL_WRITE,
@@ -288,9 +465,9 @@ int main(int argc, char *argv[])
 				   0,
 				   0,
 				   0 };
-	CHECK(zeImageCreate(context, device, &desc_A, &hAImage));
+	if (splits == 0)
+		CHECK(zeImageCreate(context, device, &desc_A, &hAImage));
 
-	ze_image_handle_t hBImage;
 	ze_image_desc_t desc_B = { ZE_STRUCTURE_TYPE_IMAGE_DESC,
 				   nullptr,
 				   ZE_IMAGE_FLAG_KERNEL_WRITE,
@@ -301,7 +478,8 @@ int main(int argc, char *argv[])
 				   0,
 				   0,
 				   0 };
-	CHECK(zeImageCreate(context, device, &desc_B, &hBImage));
+	if (splits == 0)
+		CHECK(zeImageCreate(context, device, &desc_B, &hBImage));
 
 	ze_image_handle_t hCImage;
 	ze_image_desc_t desc_C = { ZE_STRUCTURE_TYPE_IMAGE_DESC,
@@ -315,65 +493,136 @@ int main(int argc, char *argv[])
 				   0,
 				   0 };
 	CHECK(zeImageCreate(context, device, &desc_C, &hCImage));
+	allocScope.end();
+
+	if (splits == 0) {
+		CHECK(tracer.appendImageCopyFromMemory(commands, hAImage, A_in.data(), nullptr,
+						       nullptr, 0, nullptr, "upload A"));
+		CHECK(tracer.appendImageCopyFromMemory(commands, hBImage, B_in.data(), nullptr,
+						       nullptr, 0, nullptr, "upload B"));
+	} else {
+		float zero = 0.0f;
+		CHECK(zeCommandListAppendMemoryFill(commands, d_b, &zero, sizeof(zero), b_bytes,
+						    nullptr, 0, nullptr));
+		CHECK(tracer.appendBarrier(commands, nullptr, 0, nullptr));
+		CHECK(tracer.appendMemoryCopy(commands, d_a, A_in.data(), a_bytes, nullptr, 0,
+					      nullptr, "upload A"));
+		CHECK(tracer.appendMemoryCopy(commands, d_b, B_in.data(), b_used, nullptr, 0,
+					      nullptr, "upload B"));
+	}
+	CHECK(tracer.appendImageCopyFromMemory(commands, hCImage, C_out_gpu.data(), nullptr,
+					       nullptr, 0, nullptr, "upload C"));
 
-	CHECK(zeCommandListAppendImageCopyFromMemory(commands, hAImage, A_in.data(), nullptr,
-						     nullptr, 0, nullptr));
-	CHECK(zeCommandListAppendImageCopyFromMemory(commands, hBImage, B_in.data(), nullptr,
-						     nullptr, 0, nullptr));
-	CHECK(zeCommandListAppendImageCopyFromMemory(commands, hCImage, C_out_gpu.data(), nullptr,
-						     nullptr, 0, nullptr));
-
-	CHECK(zeCommandListAppendBarrier(commands, nullptr, 0, nullptr));
+	CHECK(tracer.appendBarrier(commands, nullptr, 0, nullptr));
 
 	// read in and initialize kernel
-	FILE *fp = fopen(KERNEL, "rb");
-	if (fp == nullptr) {
-		fprintf(stderr, "FAIL: unable to open %s\n", KERNEL);
-		exit(-1);
+	ZeTraceScope moduleScope(tracer, "module build");
+	/*
+	 * kernels built by the Makefile with -DSPEC_K=k have a constant k loop,
+	 * they are used when one exists for this k and the generic kernels
+	 * otherwise
+	 */
+	ZeSpecCache spec(context, device, KERNEL);
+	string spec_key = "k" + to_string(k);
+
+	/*
+	 * matrix-vector shapes are bandwidth bound, the gemv kernels stream A
+	 * (or B) once with 2D block reads instead of one group per element.
+	 * Every variant is given with the threads it needs, the tuner picks
+	 * the variant and the group size.
+	 */
+	const char *op = "sgemm";
+	vector<ze_tune_variant> variants;
+	double bytes = sizeof(float) * ((double)m * k + (double)k * n + 2.0 * m * n);
+	if (n == 1) {
+		op = "sgemv_n";
+		variants = {
+			{ "sgemv_kernel_n", nullptr,
+			  { ALIGN(c_rows, GEMV_ROWS) / GEMV_ROWS, 1, 1 } },
+			{ "sgemv_kernel_n8", nullptr, { ALIGN(c_rows, 8) / 8, 1, 1 } },
+			{ "sgemv_kernel_n32", nullptr, { ALIGN(c_rows, 32) / 32, 1, 1 } },
+		};
+	} else if (m == 1) {
+		op = "sgemv_t";
+		variants = {
+			{ "sgemv_kernel_t", nullptr,
+			  { ALIGN(c_cols, GEMV_COLS) / GEMV_COLS, 1, 1 } },
+		};
+	} else if (splits > 0) {
+		op = "sgemm_splitk";
+		variants = {
+			{ "sgemm_splitk", nullptr,
+			  { ALIGN(c_cols, SPLITK_COLS) / SPLITK_COLS, c_rows, splits } },
+		};
+	} else {
+		variants = { { "sgemm_kernel_am", nullptr, { c_cols, c_rows, 1 } } };
 	}
-	fseek(fp, 0, SEEK_END);
-	size_t sz = ftell(fp);
-	rewind(fp);
-
-	unsigned char *code = (unsigned char *)malloc(sz);
-	size_t ret = fread(code, 1, sz, fp);
-	if (ret != sz) {
-		if (feof(fp))
-			printf("Error reading kernel: unexpected end of file\n");
-		else if (ferror(fp)) {
-			perror("Error reading kernel\n");
+
+	/*kernel declarartion
+		* sgemm_kernel_am(int m, int n, int k,
+		* SurfaceIndex indxA [[type("image2d_t float")]],
+		* SurfaceIndex indxB [[type("image2d_t float")]],
+		* SurfaceIndex indxC [[type("image2d_t float")]])
+		*/
+	bool specialized = false;
+	ze_kernel_handle_t reduce = nullptr;
+	ze_group_count_t reduceCount = { ALIGN(c_cols, SPLITK_COLS) / SPLITK_COLS, c_rows, 1 };
+	for (auto &v : variants) {
+		v.kernel = spec.kernel(v.name, spec_key, "", nullptr, &specialized);
+
+		if (splits > 0) {
+			/* k is padded to 8, A and B are zero past k */
+			int k_pad = ALIGN(k, 8);
+			int lda = A_in.ld(), ldb = B_in.ld(), ldc = C_out_gpu.ld();
+			CHECK(zeKernelSetArgumentValue(v.kernel, 0, sizeof(a_rows), &a_rows));
+			CHECK(zeKernelSetArgumentValue(v.kernel, 1, sizeof(k_pad), &k_pad));
+			CHECK(zeKernelSetArgumentValue(v.kernel, 2, sizeof(kchunk), &kchunk));
+			CHECK(zeKernelSetArgumentValue(v.kernel, 3, sizeof(lda), &lda));
+			CHECK(zeKernelSetArgumentValue(v.kernel, 4, sizeof(ldb), &ldb));
+			CHECK(zeKernelSetArgumentValue(v.kernel, 5, sizeof(ldc), &ldc));
+			CHECK(zeKernelSetArgumentValue(v.kernel, 6, sizeof(d_a), &d_a));
+			CHECK(zeKernelSetArgumentValue(v.kernel, 7, sizeof(d_b), &d_b));
+			CHECK(zeKernelSetArgumentValue(v.kernel, 8, sizeof(d_p), &d_p));
+
+			reduce = spec.kernel("sgemm_splitk_reduce", spec_key);
+			CHECK(zeKernelSetGroupSize(reduce, 1, 1, 1));
+			CHECK(zeKernelSetArgumentValue(reduce, 0, sizeof(a_rows), &a_rows));
+			CHECK(zeKernelSetArgumentValue(reduce, 1, sizeof(splits), &splits));
+			CHECK(zeKernelSetArgumentValue(reduce, 2, sizeof(ldc), &ldc));
+			CHECK(zeKernelSetArgumentValue(reduce, 3, sizeof(d_p), &d_p));
+			CHECK(zeKernelSetArgumentValue(reduce, 4, sizeof(hCImage), &hCImage));
+			continue;
 		}
-		fclose(fp);
-		exit(-1);
+
+		CHECK(zeKernelSetArgumentValue(v.kernel, 0, sizeof(a_rows), &a_rows));
+		CHECK(zeKernelSetArgumentValue(v.kernel, 1, sizeof(b_cols), &b_cols));
+		CHECK(zeKernelSetArgumentValue(v.kernel, 2, sizeof(a_cols), &a_cols));
+
+		CHECK(zeKernelSetArgumentValue(v.kernel, 3, sizeof(hAImage), &hAImage));
+		CHECK(zeKernelSetArgumentValue(v.kernel, 4, sizeof(hBImage), &hBImage));
+		CHECK(zeKernelSetArgumentValue(v.kernel, 5, sizeof(hCImage), &hCImage));
 	}
-	fclose(fp);
-
-	ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
-					nullptr,
-					ZE_MODULE_FORMAT_IL_SPIRV,
-					sz,
-					code,
-					"-vc-codegen",
-					nullptr };
-	CHECK(zeModuleCreate(context, device, &moduleDesc, &module, nullptr));
-
-	const char *kernel_name = "sgemm_kernel_am";
-	ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr,
-					0, kernel_name };
-	CHECK(zeKernelCreate(module, &kernelDesc, &kernel));
-
-	// set group size - single KERNEL_SZ size entry per group
-	CHECK(zeKernelSetGroupSize(kernel, /*x*/ 1, /*y*/ 1, /*z*/ 1));
-
-	// unsigned int nThreadsX = ALIGN(c_cols, KERNEL_ALIGN) / 1;
-	unsigned int nThreadsX = 1;
-	unsigned int nThreadsY = 1;
-	// ze_group_count_t groupCount = { nThreadsX, nThreadsY, 1 };
-	ze_group_count_t groupCount = { c_cols, c_rows, 1 };
+	moduleScope.end();
+
+	/*
+	 * tuning overwrites C, every iteration below uploads it again; a
+	 * specialized kernel is tuned apart from the generic one, the shape
+	 * bucket does not tell them apart
+	 */
+	string tune_op = specialized ? string(op) + "." + spec_key : string(op);
+	ze_tune_result tuned = tuner.select(commands, tune_op, { m, n, k }, variants);
+	kernel = variants[tuned.variant].kernel;
+	const char *kernel_name = variants[tuned.variant].name;
+	ze_group_count_t groupCount = tuned.count;
+	printf("%ux%ux%u: using %s%s, group %ux%ux%u\n", m, n, k, kernel_name,
+	       specialized ? (" for " + spec_key).c_str() : "", tuned.group[0], tuned.group[1],
+	       tuned.group[2]);
+	if (splits > 0)
+		printf("k split %u ways in chunks of %u\n", splits, kchunk);
 
 	/* create event pool */
 	ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
-					   ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP, 1 };
+					   ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP, 2 };
 	ze_event_pool_handle_t hPool = nullptr;
 	CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &hPool));
 
@@ -381,34 +630,42 @@ int main(int argc, char *argv[])
 	ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, 0, 0, 0 };
 	ze_event_handle_t hEvent = nullptr;
 	CHECK(zeEventCreate(hPool, &desc, &hEvent));
+	ze_event_handle_t hReduceEvent = nullptr;
+	desc.index = 1;
+	CHECK(zeEventCreate(hPool, &desc, &hReduceEvent));
 
+	double best = std::numeric_limits<double>::max();
 	for (int iter = 0; iter < nIterations; iter++) {
-		/*kernel declarartion
-			* sgemm_kernel_am(int m, int n, int k,
-			* SurfaceIndex indxA [[type("image2d_t float")]],
-			* SurfaceIndex indxB [[type("image2d_t float")]],
-			* SurfaceIndex indxC [[type("image2d_t float")]])
-			*/
-		CHECK(zeKernelSetArgumentValue(kernel, 0, sizeof(a_rows), &a_rows));
-		CHECK(zeKernelSetArgumentValue(kernel, 1, sizeof(b_cols), &b_cols));
-		CHECK(zeKernelSetArgumentValue(kernel, 2, sizeof(a_cols), &a_cols));
-
-		CHECK(zeKernelSetArgumentValue(kernel, 3, sizeof(hAImage), &hAImage));
-		CHECK(zeKernelSetArgumentValue(kernel, 4, sizeof(hBImage), &hBImage));
-		CHECK(zeKernelSetArgumentValue(kernel, 5, sizeof(hCImage), &hCImage));
-
-		CHECK(zeCommandListAppendLaunchKernel(commands, kernel, &groupCount, hEvent, 0,
-						      nullptr));
-		zeEventHostSynchronize(hEvent, std::numeric_limits<uint32_t>::max());
+		/* every iteration starts from the original C */
+		CHECK(tracer.appendImageCopyFromMemory(commands, hCImage, C_out_gpu.data(), nullptr,
+						       nullptr, 0, nullptr, "reset C"));
+		CHECK(tracer.appendBarrier(commands, nullptr, 0, nullptr));
+
+		CHECK(tracer.appendLaunchKernel(commands, kernel, &groupCount, hEvent, 0, nullptr,
+						kernel_name));
+		double ns = 0.0;
+		if (reduce != nullptr) {
+			CHECK(tracer.appendLaunchKernel(commands, reduce, &reduceCount,
+							hReduceEvent, 1, &hEvent,
+							"sgemm_splitk_reduce"));
+			tracer.hostSynchronize(hReduceEvent, std::numeric_limits<uint32_t>::max());
+			ns += kernelTimeNs(hReduceEvent, device_properties);
+			CHECK(zeEventHostReset(hReduceEvent));
+		}
+		tracer.hostSynchronize(hEvent, std::numeric_limits<uint32_t>::max());
+		ns += kernelTimeNs(hEvent, device_properties);
+		best = min(best, ns);
 
 		CHECK(zeEventHostReset(hEvent));
 	}
+	printf("%s: %.3f us, %.2f GB/s, %.2f GFLOPS\n", kernel_name, best / 1000.0, bytes / best,
+	       2.0 * m * n * k / best);
 
 	// CHECK(zeCommandListAppendBarrier(commands, nullptr, 0, nullptr));
 	// copy result to host
-	CHECK(zeCommandListAppendImageCopyToMemory(commands, C_out_gpu.data(), hCImage, nullptr,
-						   hEvent, 0, nullptr));
-	zeEventHostSynchronize(hEvent, std::numeric_limits<uint32_t>::max());
+	CHECK(tracer.appendImageCopyToMemory(commands, C_out_gpu.data(), hCImage, nullptr, hEvent,
+					     0, nullptr, "readback C"));
+	tracer.hostSynchronize(hEvent, std::numeric_limits<uint32_t>::max());
 
 	// CHECK(zeCommandListAppendBarrier(commands, nullptr, 0, nullptr));
 
@@ -436,13 +693,31 @@ int main(int argc, char *argv[])
 	// 		exit(-1);
 	// 	}
 	//
-	if (C_out_gpu != C_test) {
+	ZeTraceScope verifyScope(tracer, "verification");
+	if (!C_out_gpu.near(C_ref, gpuThreshold(k))) {
 		printf("GPU Multiplication error\n");
 	} else
 		printf("GPU Multiplication test PASSED\n");
+	verifyScope.end();
 
-	zeImageDestroy(hAImage);
-	zeImageDestroy(hBImage);
+	const char *out = getenv("GEMM_OUT");
+	if (out != nullptr) {
+		ZeTraceScope saveScope(tracer, "save result");
+		CHECK2(!C_out_gpu.save(out), out);
+		printf("result written to %s\n", out);
+	}
+	tracer.close();
+	tuner.close();
+	spec.close();
+
+	if (splits > 0) {
+		zeMemFree(context, d_a);
+		zeMemFree(context, d_b);
+		zeMemFree(context, d_p);
+	} else {
+		zeImageDestroy(hAImage);
+		zeImageDestroy(hBImage);
+	}
 	zeImageDestroy(hCImage);
 
 	zeCommandListDestroy(commands);
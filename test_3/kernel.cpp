@@ -11,6 +11,21 @@ SPDX-License-Identifier: MIT
 #define SZ 16
 const char zero[SZ] = { 0 };
 
+// shape specialization: kernel.k<K>.spv.skl is built with -DSPEC_K=<K> and
+// used by the host when k == K, the k loops then have a constant trip count
+// and are unrolled and constant folded
+#ifdef SPEC_K
+#define K_BOUND(k) SPEC_K
+#else
+#define K_BOUND(k) (k)
+#endif
+
+// thread position in the launch grid, the host picks the group size
+inline _GENX_ uint32_t thread_id(int dim)
+{
+	return cm_group_id(dim) * cm_local_size(dim) + cm_local_id(dim);
+}
+
 // C := alpha*A*B + beta*C,
 // A(m x k) , B(k x n) , C(m x n)
 // kernel calulate 1x16 block of C
@@ -30,11 +45,11 @@ sgemm_kernel_am(int m, int n, int k,
 	//        cm_group_id(0), cm_group_id(1), cm_local_id(0), cm_local_id(1),
 	//        cm_linear_global_id());
 
-	uint32_t dst_col = cm_group_id(0) * sizeof(float);
-	uint32_t dst_row = cm_group_id(1);
+	uint32_t dst_col = thread_id(0) * sizeof(float);
+	uint32_t dst_row = thread_id(1);
 	vector<float, 16> res(zero);
 
-	for (int kk = 0; kk < k; kk += SZ) {
+	for (int kk = 0; kk < K_BOUND(k); kk += SZ) {
 		vector<float, 16> a;
 		matrix<float, 16, 1> b;
 
@@ -65,3 +80,157 @@ sgemm_kernel_am(int m, int n, int k,
 	vector<float, 1> res_scal = c_old(0) + cm_sum<float>(res);
 	write(indxC, dst_col, dst_row, res_scal);
 }
+
+#define GEMV_ROWS 16
+#define GEMV_COLS 16
+
+// C := A*B + C for n == 1, A(m x k) , B(k x 1) , C(m x 1)
+// kernel calulate ROWS x 1 block of C, A is streamed once in 8x8 blocks
+// and every chunk of x is reused for all ROWS rows
+template <int ROWS>
+inline _GENX_ void sgemv_n_tile(int k, SurfaceIndex indxA, SurfaceIndex indxB,
+				SurfaceIndex indxC)
+{
+	uint32_t dst_row = thread_id(0) * ROWS;
+	matrix<float, ROWS, 8> acc = 0.0f;
+
+	for (int kk = 0; kk < K_BOUND(k); kk += 8) {
+		matrix<float, 8, 1> x;
+		matrix<float, ROWS, 8> a;
+
+		read(indxB, 0, kk, x);
+#pragma unroll
+		for (int r = 0; r < ROWS; r += 8)
+			read(indxA, kk * sizeof(float), dst_row + r, a.select<8, 1, 8, 1>(r, 0));
+
+		acc.format<float>() += a.format<float>() * x.format<float>().replicate<ROWS>();
+	}
+
+	matrix<float, ROWS, 1> c;
+#pragma unroll
+	for (int r = 0; r < ROWS; r += 8)
+		read(indxC, 0, dst_row + r, c.select<8, 1, 1, 1>(r, 0));
+#pragma unroll
+	for (int r = 0; r < ROWS; r++)
+		c(r, 0) += cm_sum<float>(acc.row(r));
+#pragma unroll
+	for (int r = 0; r < ROWS; r += 8)
+		write(indxC, 0, dst_row + r, c.select<8, 1, 1, 1>(r, 0));
+}
+
+// sgemv_kernel_n is the GEMV_ROWS tile, the 8 and 32 row tiles are
+// variants for the autotuner
+#define SGEMV_N_KERNEL(NAME, ROWS)                                                           \
+	extern "C" _GENX_MAIN_ void NAME(int m, int n, int k,                                \
+					 SurfaceIndex indxA [[type("image2d_t float")]],     \
+					 SurfaceIndex indxB [[type("image2d_t float")]],     \
+					 SurfaceIndex indxC [[type("image2d_t float")]])     \
+	{                                                                                    \
+		sgemv_n_tile<ROWS>(k, indxA, indxB, indxC);                                  \
+	}
+
+#ifndef __INTELLISENSE__
+SGEMV_N_KERNEL(sgemv_kernel_n, GEMV_ROWS)
+SGEMV_N_KERNEL(sgemv_kernel_n8, 8)
+SGEMV_N_KERNEL(sgemv_kernel_n32, 32)
+#endif
+
+// C := A*B + C for m == 1, A(1 x k) , B(k x n) , C(1 x n)
+// kernel calulate 1 x GEMV_COLS block of C, B is streamed once in 4x16
+// blocks and every chunk of x is kept in registers
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+sgemv_kernel_t(int m, int n, int k,
+	       SurfaceIndex indxA [[type("image2d_t float")]],
+	       SurfaceIndex indxB [[type("image2d_t float")]],
+	       SurfaceIndex indxC [[type("image2d_t float")]])
+{
+	uint32_t dst_col = thread_id(0) * GEMV_COLS * sizeof(float);
+	vector<float, GEMV_COLS> acc = 0.0f;
+
+	for (int kk = 0; kk < K_BOUND(k); kk += 8) {
+		vector<float, 8> x;
+		matrix<float, 8, GEMV_COLS> b;
+
+		read(indxA, kk * sizeof(float), 0, x);
+		read(indxB, dst_col, kk, b.select<4, 1, GEMV_COLS, 1>(0, 0));
+		read(indxB, dst_col, kk + 4, b.select<4, 1, GEMV_COLS, 1>(4, 0));
+
+#pragma unroll
+		for (int t = 0; t < 8; t++)
+			acc += x(t) * b.row(t);
+	}
+
+	vector<float, GEMV_COLS> c;
+	read(indxC, dst_col, 0, c);
+	c += acc;
+	write(indxC, dst_col, 0, c);
+}
+
+// split-K: C := A*B + C for small m x n and long k, A(m x k) , B(k x n)
+// sgemm_splitk calulate the partial product of a 1 x SPLITK_COLS block of C
+// over the k range [z * kchunk, (z + 1) * kchunk) of its split z into slice
+// z of P (splits x m x ldc), sgemm_splitk_reduce adds the slices to C.
+// A, B and P are buffers with pitches lda, ldb and ldc in floats, all
+// multiples of 16; k is padded to 8 with zero columns of A and zero rows
+// of B, kchunk is a multiple of 8 as well
+#define SPLITK_COLS 16
+
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+sgemm_splitk(int m, int k, int kchunk, int lda, int ldb, int ldc,
+	     SurfaceIndex indxA [[type("buffer_t")]],
+	     SurfaceIndex indxB [[type("buffer_t")]],
+	     SurfaceIndex indxP [[type("buffer_t")]])
+{
+	uint32_t col = thread_id(0) * SPLITK_COLS;
+	uint32_t row = thread_id(1);
+	uint32_t split = thread_id(2);
+	int k0 = split * kchunk;
+	int k1 = cm_min<int>(k0 + kchunk, k);
+	vector<float, SPLITK_COLS> acc = 0.0f;
+
+	for (int kk = k0; kk < k1; kk += 8) {
+		vector<float, 8> a;
+		matrix<float, 8, SPLITK_COLS> b;
+
+		read(indxA, (row * lda + kk) * sizeof(float), a);
+#pragma unroll
+		for (int t = 0; t < 8; t++)
+			read(indxB, ((kk + t) * ldb + col) * sizeof(float), b.row(t));
+
+#pragma unroll
+		for (int t = 0; t < 8; t++)
+			acc += a(t) * b.row(t);
+	}
+
+	write(indxP, ((split * m + row) * ldc + col) * sizeof(float), acc);
+}
+
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+sgemm_splitk_reduce(int m, int splits, int ldc,
+		    SurfaceIndex indxP [[type("buffer_t")]],
+		    SurfaceIndex indxC [[type("image2d_t float")]])
+{
+	uint32_t col = thread_id(0) * SPLITK_COLS;
+	uint32_t row = thread_id(1);
+	vector<float, SPLITK_COLS> sum;
+	vector<float, SPLITK_COLS> part;
+
+	read(indxC, col * sizeof(float), row, sum);
+	for (int s = 0; s < splits; s++) {
+		read(indxP, ((s * m + row) * ldc + col) * sizeof(float), part);
+		sum += part;
+	}
+	write(indxC, col * sizeof(float), row, sum);
+}
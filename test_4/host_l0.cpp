@@ -0,0 +1,680 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <iostream>
+#include <cassert>
+#include <math.h>
+#include <vector>
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include <level_zero/ze_api.h>
+
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <thread>
+
+using namespace std;
+
+#define CHECK(a)                                                              \
+	do {                                                                  \
+		auto err = (a);                                               \
+		if (err != 0) {                                               \
+			fprintf(stderr, "FAIL: err=%d @ line=%d (%s)\n", err, \
+				__LINE__, (#a));                              \
+			exit(err);                                            \
+		}                                                             \
+	} while (0)
+#define CHECK2(a, msg)                                                      \
+	do {                                                                \
+		if ((a)) {                                                  \
+			fprintf(stderr, "FAIL: @ line=%d (%s)\n", __LINE__, \
+				(msg));                                     \
+			exit(-1);                                           \
+		}                                                           \
+	} while (0)
+#ifndef KERNEL
+#error "Error: KERNEL must be defined with location of kernel binary"
+#endif
+
+#define KERNEL_ALIGN 16LLU
+/* @a is a power of 2 value */
+#define __ALIGN_KERNEL_MASK(x, mask) (((x) + (mask)) & ~(mask))
+#define __ALIGN_KERNEL(x, a) __ALIGN_KERNEL_MASK(x, (typeof(x))(a)-1)
+#define ALIGN(x, a) __ALIGN_KERNEL((x), (a))
+
+/* rows of a SELL slice, must match SIMD in kernel.cpp */
+#define SELL_C 16
+/* threads per group for the row/slice kernels */
+#define SPMV_GROUP 8
+
+static float randData(float low, float high)
+{
+	float t = (float)rand() / (float)RAND_MAX;
+	return (1.0f - t) * low + t * high;
+}
+
+class Matrix {
+	float *M;
+	uint32_t nrows;
+	uint32_t nrows_aligned;
+	uint32_t ncols;
+	uint32_t ncols_aligned;
+
+    public:
+	float &operator()(int r, int c)
+	{
+		return M[r * ncols_aligned + c];
+	}
+
+	Matrix(uint32_t rows, uint32_t cols, bool init)
+	{
+		this->nrows = rows;
+		this->nrows_aligned = ALIGN(this->nrows, KERNEL_ALIGN);
+		this->ncols = cols;
+		this->ncols_aligned = ALIGN(this->ncols, KERNEL_ALIGN);
+
+		size_t size = sizeof(float) * this->nrows_aligned * this->ncols_aligned;
+
+		M = (float *)aligned_alloc(4096, size);
+		memset(M, 0, size);
+
+		if (init)
+			for (int i = 0; i < rows; i++)
+				for (int j = 0; j < cols; j++)
+					(*this)(i, j) = randData(0.0f, 1.0f);
+	}
+
+	uint32_t rows()
+	{
+		return nrows;
+	};
+	uint32_t cols()
+	{
+		return ncols;
+	};
+	uint32_t ld()
+	{
+		return ncols_aligned;
+	}
+	float *data()
+	{
+		return M;
+	}
+	size_t bytes()
+	{
+		return sizeof(float) * nrows_aligned * ncols_aligned;
+	}
+
+	~Matrix()
+	{
+		free(M);
+	}
+};
+
+// compressed sparse row storage, column indices are sorted inside a row
+class CsrMatrix {
+	uint32_t nrows;
+	uint32_t ncols;
+
+    public:
+	vector<uint32_t> row_ptr;
+	vector<uint32_t> col_idx;
+	vector<float> vals;
+
+	// row lengths follow a Pareto distribution with the given mean and
+	// exponent, which gives the few very long rows of a power-law graph
+	CsrMatrix(uint32_t rows, uint32_t cols, double avg_nnz, double alpha)
+		: nrows(rows)
+		, ncols(cols)
+		, row_ptr(rows + 1, 0)
+	{
+		double xmin = avg_nnz * (alpha - 2.0) / (alpha - 1.0);
+		xmin = max(xmin, 1.0);
+
+		for (uint32_t r = 0; r < nrows; r++) {
+			double u = randData(0.0f, 1.0f);
+			double len = xmin * pow(1.0 - min(u, 0.999999), -1.0 / (alpha - 1.0));
+			row_ptr[r + 1] = row_ptr[r] + (uint32_t)min(len, (double)ncols);
+		}
+
+		col_idx.resize(row_ptr[nrows]);
+		vals.resize(row_ptr[nrows]);
+		for (uint32_t r = 0; r < nrows; r++) {
+			for (uint32_t j = row_ptr[r]; j < row_ptr[r + 1]; j++) {
+				col_idx[j] = rand() % ncols;
+				vals[j] = randData(0.0f, 1.0f);
+			}
+			sort(col_idx.begin() + row_ptr[r], col_idx.begin() + row_ptr[r + 1]);
+		}
+	}
+
+	uint32_t rows() const
+	{
+		return nrows;
+	}
+	uint32_t cols() const
+	{
+		return ncols;
+	}
+	uint32_t nnz() const
+	{
+		return row_ptr[nrows];
+	}
+	uint32_t rowLen(uint32_t r) const
+	{
+		return row_ptr[r + 1] - row_ptr[r];
+	}
+};
+
+// SELL-C-sigma: rows are sorted by length inside windows of sigma rows,
+// then packed into slices of SELL_C rows padded to the longest row of the
+// slice. Sorting keeps the padding small while the slices stay SIMD-wide.
+class SellMatrix {
+	uint32_t nrows;
+	uint32_t nslices;
+
+    public:
+	vector<uint32_t> slice_info; /* { offset, width, 0, 0 } per slice */
+	vector<uint32_t> perm;
+	vector<uint32_t> col_idx;
+	vector<float> vals;
+
+	SellMatrix(const CsrMatrix &A, uint32_t sigma)
+		: nrows(A.rows())
+	{
+		nslices = (nrows + SELL_C - 1) / SELL_C;
+		perm.resize(nslices * SELL_C);
+		iota(perm.begin(), perm.end(), 0);
+
+		for (uint32_t w = 0; w < nrows; w += sigma) {
+			auto first = perm.begin() + w;
+			auto last = perm.begin() + min(w + sigma, nrows);
+			stable_sort(first, last, [&A](uint32_t a, uint32_t b) {
+				return A.rowLen(a) > A.rowLen(b);
+			});
+		}
+
+		slice_info.resize(nslices * 4, 0);
+		uint32_t offset = 0;
+		for (uint32_t s = 0; s < nslices; s++) {
+			uint32_t width = 0;
+			for (uint32_t i = 0; i < SELL_C; i++) {
+				uint32_t r = perm[s * SELL_C + i];
+				if (r < nrows)
+					width = max(width, A.rowLen(r));
+			}
+			slice_info[s * 4 + 0] = offset;
+			slice_info[s * 4 + 1] = width;
+			offset += width * SELL_C;
+		}
+
+		/* padding entries multiply x[0] by zero */
+		col_idx.assign(offset, 0);
+		vals.assign(offset, 0.0f);
+		for (uint32_t s = 0; s < nslices; s++) {
+			for (uint32_t i = 0; i < SELL_C; i++) {
+				uint32_t r = perm[s * SELL_C + i];
+				if (r >= nrows)
+					continue;
+				for (uint32_t j = 0; j < A.rowLen(r); j++) {
+					uint32_t dst = slice_info[s * 4] + j * SELL_C + i;
+					col_idx[dst] = A.col_idx[A.row_ptr[r] + j];
+					vals[dst] = A.vals[A.row_ptr[r] + j];
+				}
+			}
+		}
+	}
+
+	uint32_t slices() const
+	{
+		return nslices;
+	}
+	uint32_t stored() const
+	{
+		return col_idx.size();
+	}
+};
+
+static unsigned cpuThreads()
+{
+	return max(1u, thread::hardware_concurrency());
+}
+
+// merge-path SpMV (Merrill & Garland): every CPU thread gets an equal share
+// of rows + nonzeros, so one huge row cannot stall a single thread. Sums are
+// kept in double, the result is the reference the GPU is checked against.
+static void spmvMergePath(const CsrMatrix &A, const float *x, float *y, unsigned nthreads)
+{
+	const uint32_t *row_end = &A.row_ptr[1];
+	const uint32_t m = A.rows();
+	const uint32_t nnz = A.nnz();
+	const uint64_t total = (uint64_t)m + nnz;
+	const uint64_t per_thread = (total + nthreads - 1) / nthreads;
+
+	auto search = [&](uint64_t diag, uint32_t &row, uint32_t &nz) {
+		int64_t lo = max<int64_t>((int64_t)diag - nnz, 0);
+		int64_t hi = min<int64_t>(diag, m);
+		while (lo < hi) {
+			int64_t pivot = (lo + hi) >> 1;
+			if (row_end[pivot] <= diag - pivot - 1)
+				lo = pivot + 1;
+			else
+				hi = pivot;
+		}
+		row = min<int64_t>(lo, m);
+		nz = diag - lo;
+	};
+
+	vector<uint32_t> carry_row(nthreads);
+	vector<double> carry_val(nthreads);
+	vector<thread> workers;
+
+	for (unsigned t = 0; t < nthreads; t++) {
+		workers.emplace_back([&, t]() {
+			uint64_t d0 = min(per_thread * t, total);
+			uint64_t d1 = min(d0 + per_thread, total);
+			uint32_t r, n, r_end, n_end;
+			search(d0, r, n);
+			search(d1, r_end, n_end);
+
+			double sum = 0.0;
+			for (; r < r_end; r++) {
+				for (; n < row_end[r]; n++)
+					sum += (double)A.vals[n] * x[A.col_idx[n]];
+				y[r] = sum;
+				sum = 0.0;
+			}
+			for (; n < n_end; n++)
+				sum += (double)A.vals[n] * x[A.col_idx[n]];
+
+			carry_row[t] = r_end;
+			carry_val[t] = sum;
+		});
+	}
+	for (auto &w : workers)
+		w.join();
+
+	for (unsigned t = 0; t < nthreads; t++)
+		if (carry_row[t] < m)
+			y[carry_row[t]] = (double)y[carry_row[t]] + carry_val[t];
+}
+
+// C := A*B accumulated in double, rows are split between threads by nonzero
+// count
+static void spmmRef(const CsrMatrix &A, Matrix &B, Matrix &C, unsigned nthreads)
+{
+	vector<uint32_t> split(nthreads + 1, A.rows());
+	split[0] = 0;
+	for (unsigned t = 1; t < nthreads; t++) {
+		uint64_t target = (uint64_t)A.nnz() * t / nthreads;
+		split[t] = upper_bound(A.row_ptr.begin(), A.row_ptr.end(), target) -
+			   A.row_ptr.begin() - 1;
+		split[t] = max(split[t], split[t - 1]);
+	}
+
+	vector<thread> workers;
+	for (unsigned t = 0; t < nthreads; t++) {
+		workers.emplace_back([&, t]() {
+			vector<double> acc(C.cols());
+			for (uint32_t r = split[t]; r < split[t + 1]; r++) {
+				fill(acc.begin(), acc.end(), 0.0);
+				for (uint32_t j = A.row_ptr[r]; j < A.row_ptr[r + 1]; j++) {
+					double v = A.vals[j];
+					uint32_t k = A.col_idx[j];
+					for (uint32_t c = 0; c < C.cols(); c++)
+						acc[c] += v * B(k, c);
+				}
+				for (uint32_t c = 0; c < C.cols(); c++)
+					C(r, c) = acc[c];
+			}
+		});
+	}
+	for (auto &w : workers)
+		w.join();
+}
+
+#define CORRECTNESS_THRESHOLD 0.00002
+// relative error a GPU sum of len products may have: its float rounding
+// grows with sqrt(len), the threshold of a short row is the floor
+static double rowThreshold(uint32_t len)
+{
+	double t = 8 * numeric_limits<float>::epsilon() * sqrt((double)len);
+	return max(t, (double)CORRECTNESS_THRESHOLD);
+}
+
+// n results in rows of ld elements, row r of A is the sum behind row r
+static bool compare(const float *ref, const float *res, size_t n, size_t ld, const CsrMatrix &A,
+		    const char *what)
+{
+	double max_relerror = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		double relerror = fabs(ref[i] - res[i]) / max(fabs(ref[i]), fabs(res[i]));
+		if (ref[i] == res[i])
+			relerror = 0.0;
+		max_relerror = max(max_relerror, relerror);
+		size_t r = i / ld;
+		if (relerror > rowThreshold(A.row_ptr[r + 1] - A.row_ptr[r])) {
+			printf("%s: failure %f %f relerror: %lf at [%zu]\n", what, ref[i], res[i],
+			       relerror, i);
+			return false;
+		}
+	}
+	printf("%s: max_relerror = %e\n", what, max_relerror);
+	return true;
+}
+
+static double kernelTimeNs(ze_event_handle_t hEvent, ze_device_properties_t &props)
+{
+	ze_kernel_timestamp_result_t ts;
+	CHECK(zeEventQueryKernelTimestamp(hEvent, &ts));
+
+	uint64_t mask = props.kernelTimestampValidBits >= 64 ?
+				~0ULL :
+				(1ULL << props.kernelTimestampValidBits) - 1;
+	uint64_t cycles = (ts.context.kernelEnd - ts.context.kernelStart) & mask;
+	/* timerResolution is in ns per cycle */
+	return cycles * (double)props.timerResolution;
+}
+
+int main(int argc, char *argv[])
+{
+	uint32_t m = 1 << 16, k = 1 << 16, n = 64;
+	double avg_nnz = 16.0, alpha = 2.1;
+	uint32_t sigma = 1024;
+	int nIterations = 10;
+
+	if (argc > 1)
+		m = k = atoi(argv[1]);
+	if (argc > 2)
+		avg_nnz = atof(argv[2]);
+	if (argc > 3)
+		alpha = atof(argv[3]);
+
+	CsrMatrix A(m, k, avg_nnz, alpha);
+	SellMatrix A_sell(A, sigma);
+	uint32_t max_row = 0;
+	for (uint32_t r = 0; r < A.rows(); r++)
+		max_row = max(max_row, A.rowLen(r));
+	printf("A %ux%u nnz=%u max row=%u, SELL-%d-%u fill=%.2f\n", m, k, A.nnz(), max_row,
+	       SELL_C, sigma, (double)A_sell.stored() / max(A.nnz(), 1u));
+
+	vector<float> x(k);
+	for (auto &v : x)
+		v = randData(0.0f, 1.0f);
+	vector<float> y_ref(m), y_gpu(A_sell.slices() * SELL_C);
+
+	Matrix B_in(k, n, true);
+	Matrix C_ref(m, n, false);
+	Matrix C_gpu(m, n, false);
+
+	unsigned nthreads = cpuThreads();
+	auto t0 = chrono::steady_clock::now();
+	spmvMergePath(A, x.data(), y_ref.data(), nthreads);
+	auto t1 = chrono::steady_clock::now();
+	spmmRef(A, B_in, C_ref, nthreads);
+	auto t2 = chrono::steady_clock::now();
+	printf("CPU reference (%u threads): spmv %.3f ms, spmm %.3f ms\n", nthreads,
+	       chrono::duration<double, milli>(t1 - t0).count(),
+	       chrono::duration<double, milli>(t2 - t1).count());
+
+	// initialize GPU
+	ze_driver_handle_t driver = nullptr;
+	ze_device_handle_t device = nullptr;
+	ze_context_handle_t context = nullptr;
+	ze_command_queue_handle_t queue;
+	ze_command_list_handle_t commands;
+	ze_module_handle_t module;
+
+	CHECK(zeInit(ZE_INIT_FLAG_GPU_ONLY));
+
+	// Discover all the driver instances
+	uint32_t driverCount = 0;
+	CHECK(zeDriverGet(&driverCount, nullptr));
+	CHECK2((driverCount == 0), "unable to locate driver(s)");
+
+	ze_driver_handle_t *allDrivers =
+		(ze_driver_handle_t *)malloc(driverCount * sizeof(*allDrivers));
+	CHECK(zeDriverGet(&driverCount, allDrivers));
+
+	// Find a driver instance with a GPU device
+	for (uint32_t i = 0; i < driverCount; ++i) {
+		uint32_t deviceCount = 0;
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, nullptr));
+		if (deviceCount == 0)
+			continue;
+		ze_device_handle_t *allDevices = (ze_device_handle_t *)malloc(
+			deviceCount * sizeof(ze_device_handle_t));
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, allDevices));
+		for (uint32_t d = 0; d < deviceCount; ++d) {
+			ze_device_properties_t device_properties;
+			CHECK(zeDeviceGetProperties(allDevices[d],
+						    &device_properties));
+			if (ZE_DEVICE_TYPE_GPU == device_properties.type) {
+				fprintf(stderr,
+					"INFO: GPU device located driver=%d, device=%d\n",
+					i, d);
+				driver = allDrivers[i];
+				device = allDevices[d];
+				break;
+			}
+		}
+		if (nullptr != device)
+			break;
+	}
+	CHECK2((driver == nullptr), "unable to locate driver with GPU device");
+	CHECK2((device == nullptr), "unable to locate GPU device");
+
+	ze_device_properties_t device_properties;
+	CHECK(zeDeviceGetProperties(device, &device_properties));
+
+	ze_context_desc_t contextDesc = { ZE_STRUCTURE_TYPE_CONTEXT_DESC,
+					  nullptr, 0 };
+	CHECK(zeContextCreate(driver, &contextDesc, &context));
+
+	// create a command queue and list
+	ze_command_queue_desc_t commandQueueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
+						     nullptr,
+						     0,
+						     0,
+						     0,
+						     ZE_COMMAND_QUEUE_MODE_DEFAULT,
+						     ZE_COMMAND_QUEUE_PRIORITY_NORMAL };
+	CHECK(zeCommandQueueCreate(context, device, &commandQueueDesc, &queue));
+
+	CHECK(zeCommandListCreateImmediate(context, device, &commandQueueDesc, &commands));
+
+	/* create event pool */
+	ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
+					   ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP, 1 };
+	ze_event_pool_handle_t hPool = nullptr;
+	CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &hPool));
+
+	/* create event */
+	ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, 0, 0, 0 };
+	ze_event_handle_t hEvent = nullptr;
+	CHECK(zeEventCreate(hPool, &desc, &hEvent));
+
+	ze_device_mem_alloc_desc_t deviceMemDesc = {
+		ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC, nullptr, 0, 0
+	};
+	vector<void *> allocations;
+	auto toDevice = [&](const void *src, size_t bytes) {
+		void *ptr = nullptr;
+		CHECK(zeMemAllocDevice(context, &deviceMemDesc, max<size_t>(bytes, 64), 64,
+				       device, &ptr));
+		if (src != nullptr)
+			CHECK(zeCommandListAppendMemoryCopy(commands, ptr, src, bytes, nullptr,
+							    0, nullptr));
+		allocations.push_back(ptr);
+		return ptr;
+	};
+
+	void *d_row_ptr = toDevice(A.row_ptr.data(), A.row_ptr.size() * sizeof(uint32_t));
+	void *d_col_idx = toDevice(A.col_idx.data(), A.col_idx.size() * sizeof(uint32_t));
+	void *d_vals = toDevice(A.vals.data(), A.vals.size() * sizeof(float));
+	void *d_slice_info =
+		toDevice(A_sell.slice_info.data(), A_sell.slice_info.size() * sizeof(uint32_t));
+	void *d_perm = toDevice(A_sell.perm.data(), A_sell.perm.size() * sizeof(uint32_t));
+	void *d_sell_col = toDevice(A_sell.col_idx.data(), A_sell.col_idx.size() * sizeof(uint32_t));
+	void *d_sell_vals = toDevice(A_sell.vals.data(), A_sell.vals.size() * sizeof(float));
+	void *d_x = toDevice(x.data(), x.size() * sizeof(float));
+	void *d_y = toDevice(nullptr, y_gpu.size() * sizeof(float));
+	void *d_B = toDevice(B_in.data(), B_in.bytes());
+	void *d_C = toDevice(nullptr, C_gpu.bytes());
+
+	CHECK(zeCommandListAppendBarrier(commands, hEvent, 0, nullptr));
+	CHECK(zeEventHostSynchronize(hEvent, std::numeric_limits<uint64_t>::max()));
+	CHECK(zeEventHostReset(hEvent));
+
+	// read in and initialize kernel
+	FILE *fp = fopen(KERNEL, "rb");
+	if (fp == nullptr) {
+		fprintf(stderr, "FAIL: unable to open %s\n", KERNEL);
+		exit(-1);
+	}
+	fseek(fp, 0, SEEK_END);
+	size_t sz = ftell(fp);
+	rewind(fp);
+
+	unsigned char *code = (unsigned char *)malloc(sz);
+	size_t ret = fread(code, 1, sz, fp);
+	if (ret != sz) {
+		if (feof(fp))
+			printf("Error reading kernel: unexpected end of file\n");
+		else if (ferror(fp)) {
+			perror("Error reading kernel\n");
+		}
+		fclose(fp);
+		exit(-1);
+	}
+	fclose(fp);
+
+	ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
+					nullptr,
+					ZE_MODULE_FORMAT_IL_SPIRV,
+					sz,
+					code,
+					"-vc-codegen",
+					nullptr };
+	CHECK(zeModuleCreate(context, device, &moduleDesc, &module, nullptr));
+
+	ze_kernel_handle_t k_csr, k_sell, k_spmm;
+	ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0, "spmv_csr_row" };
+	CHECK(zeKernelCreate(module, &kernelDesc, &k_csr));
+	kernelDesc.pKernelName = "spmv_sell";
+	CHECK(zeKernelCreate(module, &kernelDesc, &k_sell));
+	kernelDesc.pKernelName = "spmm_csr";
+	CHECK(zeKernelCreate(module, &kernelDesc, &k_spmm));
+
+	/*kernel declarartion
+	 * spmv_csr_row(int m, row_ptr, col_idx, vals, x, y)
+	 */
+	CHECK(zeKernelSetArgumentValue(k_csr, 0, sizeof(m), &m));
+	CHECK(zeKernelSetArgumentValue(k_csr, 1, sizeof(d_row_ptr), &d_row_ptr));
+	CHECK(zeKernelSetArgumentValue(k_csr, 2, sizeof(d_col_idx), &d_col_idx));
+	CHECK(zeKernelSetArgumentValue(k_csr, 3, sizeof(d_vals), &d_vals));
+	CHECK(zeKernelSetArgumentValue(k_csr, 4, sizeof(d_x), &d_x));
+	CHECK(zeKernelSetArgumentValue(k_csr, 5, sizeof(d_y), &d_y));
+	CHECK(zeKernelSetGroupSize(k_csr, SPMV_GROUP, 1, 1));
+
+	/*kernel declarartion
+	 * spmv_sell(int nslices, slice_info, col_idx, vals, perm, x, y)
+	 */
+	uint32_t nslices = A_sell.slices();
+	CHECK(zeKernelSetArgumentValue(k_sell, 0, sizeof(nslices), &nslices));
+	CHECK(zeKernelSetArgumentValue(k_sell, 1, sizeof(d_slice_info), &d_slice_info));
+	CHECK(zeKernelSetArgumentValue(k_sell, 2, sizeof(d_sell_col), &d_sell_col));
+	CHECK(zeKernelSetArgumentValue(k_sell, 3, sizeof(d_sell_vals), &d_sell_vals));
+	CHECK(zeKernelSetArgumentValue(k_sell, 4, sizeof(d_perm), &d_perm));
+	CHECK(zeKernelSetArgumentValue(k_sell, 5, sizeof(d_x), &d_x));
+	CHECK(zeKernelSetArgumentValue(k_sell, 6, sizeof(d_y), &d_y));
+	CHECK(zeKernelSetGroupSize(k_sell, SPMV_GROUP, 1, 1));
+
+	/*kernel declarartion
+	 * spmm_csr(int m, int ldb, int ldc, row_ptr, col_idx, vals, B, C)
+	 */
+	uint32_t ldb = B_in.ld(), ldc = C_gpu.ld();
+	CHECK(zeKernelSetArgumentValue(k_spmm, 0, sizeof(m), &m));
+	CHECK(zeKernelSetArgumentValue(k_spmm, 1, sizeof(ldb), &ldb));
+	CHECK(zeKernelSetArgumentValue(k_spmm, 2, sizeof(ldc), &ldc));
+	CHECK(zeKernelSetArgumentValue(k_spmm, 3, sizeof(d_row_ptr), &d_row_ptr));
+	CHECK(zeKernelSetArgumentValue(k_spmm, 4, sizeof(d_col_idx), &d_col_idx));
+	CHECK(zeKernelSetArgumentValue(k_spmm, 5, sizeof(d_vals), &d_vals));
+	CHECK(zeKernelSetArgumentValue(k_spmm, 6, sizeof(d_B), &d_B));
+	CHECK(zeKernelSetArgumentValue(k_spmm, 7, sizeof(d_C), &d_C));
+	CHECK(zeKernelSetGroupSize(k_spmm, 1, 1, 1));
+
+	ze_group_count_t csrCount = { (m + SPMV_GROUP - 1) / SPMV_GROUP, 1, 1 };
+	ze_group_count_t sellCount = { (nslices + SPMV_GROUP - 1) / SPMV_GROUP, 1, 1 };
+	ze_group_count_t spmmCount = { C_gpu.ld() / 16, m, 1 };
+
+	/* compulsory traffic: the matrix, x and y once */
+	double csr_bytes = (m + 1) * 4.0 + A.nnz() * 8.0 + k * 4.0 + m * 4.0;
+	double sell_bytes = nslices * 16.0 + A_sell.stored() * 8.0 + nslices * SELL_C * 8.0 +
+			    k * 4.0;
+	double spmm_bytes = (m + 1) * 4.0 + A.nnz() * 8.0 + (double)k * n * 4 + (double)m * n * 4;
+
+	auto run = [&](ze_kernel_handle_t kernel, ze_group_count_t &groupCount, const char *name,
+		       double bytes) {
+		double best = std::numeric_limits<double>::max();
+		for (int iter = 0; iter < nIterations; iter++) {
+			CHECK(zeCommandListAppendLaunchKernel(commands, kernel, &groupCount, hEvent,
+							      0, nullptr));
+			CHECK(zeEventHostSynchronize(hEvent, std::numeric_limits<uint64_t>::max()));
+			best = min(best, kernelTimeNs(hEvent, device_properties));
+			CHECK(zeEventHostReset(hEvent));
+		}
+		printf("%-14s %10.3f us %8.2f GB/s\n", name, best / 1000.0, bytes / best);
+	};
+
+	auto readBack = [&](void *dst, void *src, size_t bytes) {
+		CHECK(zeCommandListAppendMemoryCopy(commands, dst, src, bytes, hEvent, 0, nullptr));
+		CHECK(zeEventHostSynchronize(hEvent, std::numeric_limits<uint64_t>::max()));
+		CHECK(zeEventHostReset(hEvent));
+	};
+
+	bool passed = true;
+
+	run(k_csr, csrCount, "spmv_csr_row", csr_bytes);
+	readBack(y_gpu.data(), d_y, y_gpu.size() * sizeof(float));
+	passed &= compare(y_ref.data(), y_gpu.data(), m, 1, A, "spmv_csr_row");
+
+	run(k_sell, sellCount, "spmv_sell", sell_bytes);
+	readBack(y_gpu.data(), d_y, y_gpu.size() * sizeof(float));
+	passed &= compare(y_ref.data(), y_gpu.data(), m, 1, A, "spmv_sell");
+
+	run(k_spmm, spmmCount, "spmm_csr", spmm_bytes);
+	readBack(C_gpu.data(), d_C, C_gpu.bytes());
+	passed &= compare(C_ref.data(), C_gpu.data(), (size_t)m * C_gpu.ld(), C_gpu.ld(), A,
+			  "spmm_csr");
+
+	printf(passed ? "GPU sparse test PASSED\n" : "GPU sparse test FAILED\n");
+
+	for (auto ptr : allocations)
+		CHECK(zeMemFree(context, ptr));
+
+	zeEventDestroy(hEvent);
+	zeEventPoolDestroy(hPool);
+	zeKernelDestroy(k_csr);
+	zeKernelDestroy(k_sell);
+	zeKernelDestroy(k_spmm);
+	zeModuleDestroy(module);
+	zeCommandListDestroy(commands);
+	zeContextDestroy(context);
+
+	printf("done\n");
+
+	return passed ? 0 : -1;
+}
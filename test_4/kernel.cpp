@@ -0,0 +1,151 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <cm/cm.h>
+
+#define SIMD 16
+const uint32_t lane_init[SIMD] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+// y := A*x, A(m x k) in CSR
+// one thread per row, the nonzeros of the row are walked SIMD-wide,
+// so long rows of a power-law matrix are not serialized on one lane
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+spmv_csr_row(int m,
+	     SurfaceIndex row_ptr [[type("buffer_t")]],
+	     SurfaceIndex col_idx [[type("buffer_t")]],
+	     SurfaceIndex vals [[type("buffer_t")]],
+	     SurfaceIndex x [[type("buffer_t")]],
+	     SurfaceIndex y [[type("buffer_t")]])
+{
+	uint32_t row = cm_linear_global_id();
+	if (row >= m)
+		return;
+
+	vector<uint32_t, SIMD> lane(lane_init);
+	vector<uint32_t, 8> rp_off = cm_min<uint32_t>(lane.select<8, 1>(0), 1) + row;
+	vector<uint32_t, 8> rp;
+	read(row_ptr, 0, rp_off, rp);
+	uint32_t start = rp(0);
+	uint32_t end = rp(1);
+
+	vector<float, SIMD> acc = 0.0f;
+	for (uint32_t j = start; j < end; j += SIMD) {
+		vector<uint32_t, SIMD> off = lane + j;
+		vector<ushort, SIMD> tail = off >= end;
+		off.merge(start, tail);
+
+		vector<uint32_t, SIMD> c;
+		vector<float, SIMD> v;
+		vector<float, SIMD> xv;
+		read(col_idx, 0, off, c);
+		read(vals, 0, off, v);
+		read(x, 0, c, xv);
+		v.merge(0.0f, tail);
+
+		acc += v * xv;
+	}
+
+	vector<uint32_t, 8> y_off = row;
+	vector<float, 8> res = cm_sum<float>(acc);
+	write(y, 0, y_off, res);
+}
+
+// y := A*x, A in SELL-16-sigma
+// one thread per slice of 16 rows, slice_info holds { offset, width, 0, 0 }
+// per slice, values and columns are stored column-major inside the slice so
+// every step is a 64 byte block read, rows are scattered back through perm
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+spmv_sell(int nslices,
+	  SurfaceIndex slice_info [[type("buffer_t")]],
+	  SurfaceIndex col_idx [[type("buffer_t")]],
+	  SurfaceIndex vals [[type("buffer_t")]],
+	  SurfaceIndex perm [[type("buffer_t")]],
+	  SurfaceIndex x [[type("buffer_t")]],
+	  SurfaceIndex y [[type("buffer_t")]])
+{
+	uint32_t s = cm_linear_global_id();
+	if (s >= nslices)
+		return;
+
+	vector<uint32_t, 4> info;
+	read(slice_info, s * 4 * sizeof(uint32_t), info);
+	uint32_t offset = info(0);
+	uint32_t width = info(1);
+
+	vector<float, SIMD> acc = 0.0f;
+	for (uint32_t j = 0; j < width; j++) {
+		uint32_t base = (offset + j * SIMD) * sizeof(float);
+		vector<uint32_t, SIMD> c;
+		vector<float, SIMD> v;
+		vector<float, SIMD> xv;
+
+		read(col_idx, base, c);
+		read(vals, base, v);
+		read(x, 0, c, xv);
+
+		acc += v * xv;
+	}
+
+	vector<uint32_t, SIMD> rows;
+	read(perm, s * SIMD * sizeof(uint32_t), rows);
+	write(y, 0, rows, acc);
+}
+
+// C := A*B, A(m x k) in CSR, B(k x n) and C(m x n) dense row major
+// kernel calulate 1x16 block of C, ldb and ldc are multiples of 16
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+spmm_csr(int m, int ldb, int ldc,
+	 SurfaceIndex row_ptr [[type("buffer_t")]],
+	 SurfaceIndex col_idx [[type("buffer_t")]],
+	 SurfaceIndex vals [[type("buffer_t")]],
+	 SurfaceIndex B [[type("buffer_t")]],
+	 SurfaceIndex C [[type("buffer_t")]])
+{
+	uint32_t dst_col = cm_group_id(0) * SIMD;
+	uint32_t dst_row = cm_group_id(1);
+
+	vector<uint32_t, SIMD> lane(lane_init);
+	vector<uint32_t, 8> rp_off = cm_min<uint32_t>(lane.select<8, 1>(0), 1) + dst_row;
+	vector<uint32_t, 8> rp;
+	read(row_ptr, 0, rp_off, rp);
+	uint32_t start = rp(0);
+	uint32_t end = rp(1);
+
+	vector<float, SIMD> acc = 0.0f;
+	for (uint32_t j = start; j < end; j += SIMD) {
+		vector<uint32_t, SIMD> off = lane + j;
+		vector<ushort, SIMD> tail = off >= end;
+		off.merge(start, tail);
+
+		vector<uint32_t, SIMD> c;
+		vector<float, SIMD> v;
+		read(col_idx, 0, off, c);
+		read(vals, 0, off, v);
+
+		uint32_t cnt = cm_min<uint32_t>(end - j, SIMD);
+		for (uint32_t t = 0; t < cnt; t++) {
+			vector<float, SIMD> b;
+			read(B, (c(t) * ldb + dst_col) * sizeof(float), b);
+			acc += v(t) * b;
+		}
+	}
+
+	write(C, (dst_row * ldc + dst_col) * sizeof(float), acc);
+}
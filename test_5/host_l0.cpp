@@ -0,0 +1,509 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <iostream>
+#include <cassert>
+#include <math.h>
+#include <vector>
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include <level_zero/ze_api.h>
+
+#include <algorithm>
+
+using namespace std;
+
+#define CHECK(a)                                                              \
+	do {                                                                  \
+		auto err = (a);                                               \
+		if (err != 0) {                                               \
+			fprintf(stderr, "FAIL: err=%d @ line=%d (%s)\n", err, \
+				__LINE__, (#a));                              \
+			exit(err);                                            \
+		}                                                             \
+	} while (0)
+#define CHECK2(a, msg)                                                      \
+	do {                                                                \
+		if ((a)) {                                                  \
+			fprintf(stderr, "FAIL: @ line=%d (%s)\n", __LINE__, \
+				(msg));                                     \
+			exit(-1);                                           \
+		}                                                           \
+	} while (0)
+#ifndef KERNEL
+#error "Error: KERNEL must be defined with location of kernel binary"
+#endif
+
+/* output tile of a thread, must match kernel.cpp */
+#define TILE_W 8
+#define TILE_H 8
+#define NHWC_PIX 4
+#define NHWC_OC 16
+
+static float randData(float low, float high)
+{
+	float t = (float)rand() / (float)RAND_MAX;
+	return (1.0f - t) * low + t * high;
+}
+
+static inline int clampi(int v, int lo, int hi)
+{
+	return min(max(v, lo), hi);
+}
+
+// dst := src (*) filter with clamp-to-edge border
+static void conv2dRef(const float *src, float *dst, int w, int h, const float *filter, int K)
+{
+	int R = K / 2;
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			float acc = 0.0f;
+			for (int dy = 0; dy < K; dy++)
+				for (int dx = 0; dx < K; dx++)
+					acc += filter[dy * K + dx] *
+					       src[clampi(y + dy - R, 0, h - 1) * w +
+						   clampi(x + dx - R, 0, w - 1)];
+			dst[y * w + x] = acc;
+		}
+}
+
+// horizontal then vertical pass, both with clamp-to-edge border
+static void separableRef(const float *src, float *dst, int w, int h, const float *filter, int K)
+{
+	int R = K / 2;
+	vector<float> tmp(w * h);
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			float acc = 0.0f;
+			for (int i = 0; i < K; i++)
+				acc += filter[i] * src[y * w + clampi(x + i - R, 0, w - 1)];
+			tmp[y * w + x] = acc;
+		}
+	for (int y = 0; y < h; y++)
+		for (int x = 0; x < w; x++) {
+			float acc = 0.0f;
+			for (int i = 0; i < K; i++)
+				acc += filter[i] * tmp[clampi(y + i - R, 0, h - 1) * w + x];
+			dst[y * w + x] = acc;
+		}
+}
+
+// 3x3 stride 1 convolution with zero padding, src is CHW, dst is CHW,
+// weights are OIHW
+static void convNchwRef(const float *src, float *dst, const float *weights, int c_in, int c_out,
+			int w, int h)
+{
+	for (int oc = 0; oc < c_out; oc++)
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++) {
+				float acc = 0.0f;
+				for (int ic = 0; ic < c_in; ic++)
+					for (int dy = 0; dy < 3; dy++)
+						for (int dx = 0; dx < 3; dx++) {
+							int sy = y + dy - 1, sx = x + dx - 1;
+							if (sy < 0 || sy >= h || sx < 0 || sx >= w)
+								continue;
+							acc += weights[((oc * c_in + ic) * 3 + dy) * 3 + dx] *
+							       src[(ic * h + sy) * w + sx];
+						}
+				dst[(oc * h + y) * w + x] = acc;
+			}
+}
+
+#define CORRECTNESS_THRESHOLD 0.00002
+static bool compare(const float *ref, const float *res, size_t n, const char *what)
+{
+	double max_relerror = 0.0;
+	for (size_t i = 0; i < n; i++) {
+		double relerror = fabs(ref[i] - res[i]) / max(fabs(ref[i]), fabs(res[i]));
+		if (ref[i] == res[i])
+			relerror = 0.0;
+		max_relerror = max(max_relerror, relerror);
+		if (relerror > CORRECTNESS_THRESHOLD) {
+			printf("%s: failure %f %f relerror: %lf at [%zu]\n", what, ref[i], res[i],
+			       relerror, i);
+			return false;
+		}
+	}
+	printf("%s: max_relerror = %e\n", what, max_relerror);
+	return true;
+}
+
+static double kernelTimeNs(ze_event_handle_t hEvent, ze_device_properties_t &props)
+{
+	ze_kernel_timestamp_result_t ts;
+	CHECK(zeEventQueryKernelTimestamp(hEvent, &ts));
+
+	uint64_t mask = props.kernelTimestampValidBits >= 64 ?
+				~0ULL :
+				(1ULL << props.kernelTimestampValidBits) - 1;
+	uint64_t cycles = (ts.context.kernelEnd - ts.context.kernelStart) & mask;
+	/* timerResolution is in ns per cycle */
+	return cycles * (double)props.timerResolution;
+}
+
+int main(int argc, char *argv[])
+{
+	int img_w = 1024, img_h = 1024;
+	int c_in = 16, c_out = 32, cnn_w = 64, cnn_h = 64;
+	int nIterations = 10;
+
+	if (argc > 2) {
+		img_w = atoi(argv[1]) / TILE_W * TILE_W;
+		img_h = atoi(argv[2]) / TILE_H * TILE_H;
+	}
+
+	vector<float> img(img_w * img_h);
+	for (auto &v : img)
+		v = randData(0.0f, 1.0f);
+
+	/* CNN input in CHW, weights in OIHW, converted below for the layouts */
+	vector<float> act(c_in * cnn_h * cnn_w);
+	vector<float> weights(c_out * c_in * 9);
+	for (auto &v : act)
+		v = randData(0.0f, 1.0f);
+	for (auto &v : weights)
+		v = randData(0.0f, 1.0f);
+
+	// initialize GPU
+	ze_driver_handle_t driver = nullptr;
+	ze_device_handle_t device = nullptr;
+	ze_context_handle_t context = nullptr;
+	ze_command_queue_handle_t queue;
+	ze_command_list_handle_t commands;
+	ze_module_handle_t module;
+
+	CHECK(zeInit(ZE_INIT_FLAG_GPU_ONLY));
+
+	// Discover all the driver instances
+	uint32_t driverCount = 0;
+	CHECK(zeDriverGet(&driverCount, nullptr));
+	CHECK2((driverCount == 0), "unable to locate driver(s)");
+
+	ze_driver_handle_t *allDrivers =
+		(ze_driver_handle_t *)malloc(driverCount * sizeof(*allDrivers));
+	CHECK(zeDriverGet(&driverCount, allDrivers));
+
+	// Find a driver instance with a GPU device
+	for (uint32_t i = 0; i < driverCount; ++i) {
+		uint32_t deviceCount = 0;
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, nullptr));
+		if (deviceCount == 0)
+			continue;
+		ze_device_handle_t *allDevices = (ze_device_handle_t *)malloc(
+			deviceCount * sizeof(ze_device_handle_t));
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, allDevices));
+		for (uint32_t d = 0; d < deviceCount; ++d) {
+			ze_device_properties_t device_properties;
+			CHECK(zeDeviceGetProperties(allDevices[d],
+						    &device_properties));
+			if (ZE_DEVICE_TYPE_GPU == device_properties.type) {
+				fprintf(stderr,
+					"INFO: GPU device located driver=%d, device=%d\n",
+					i, d);
+				driver = allDrivers[i];
+				device = allDevices[d];
+				break;
+			}
+		}
+		if (nullptr != device)
+			break;
+	}
+	CHECK2((driver == nullptr), "unable to locate driver with GPU device");
+	CHECK2((device == nullptr), "unable to locate GPU device");
+
+	ze_device_properties_t device_properties;
+	CHECK(zeDeviceGetProperties(device, &device_properties));
+
+	ze_context_desc_t contextDesc = { ZE_STRUCTURE_TYPE_CONTEXT_DESC,
+					  nullptr, 0 };
+	CHECK(zeContextCreate(driver, &contextDesc, &context));
+
+	// create a command queue and list
+	ze_command_queue_desc_t commandQueueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
+						     nullptr,
+						     0,
+						     0,
+						     0,
+						     ZE_COMMAND_QUEUE_MODE_DEFAULT,
+						     ZE_COMMAND_QUEUE_PRIORITY_NORMAL };
+	CHECK(zeCommandQueueCreate(context, device, &commandQueueDesc, &queue));
+
+	CHECK(zeCommandListCreateImmediate(context, device, &commandQueueDesc, &commands));
+
+	/* create event pool */
+	ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
+					   ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP, 1 };
+	ze_event_pool_handle_t hPool = nullptr;
+	CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &hPool));
+
+	/* create event */
+	ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, 0, 0, 0 };
+	ze_event_handle_t hEvent = nullptr;
+	CHECK(zeEventCreate(hPool, &desc, &hEvent));
+
+	auto sync = [&]() {
+		CHECK(zeCommandListAppendBarrier(commands, hEvent, 0, nullptr));
+		CHECK(zeEventHostSynchronize(hEvent, std::numeric_limits<uint64_t>::max()));
+		CHECK(zeEventHostReset(hEvent));
+	};
+
+	ze_image_format_t img_fmt = { ZE_IMAGE_FORMAT_LAYOUT_32,
+				      ZE_IMAGE_FORMAT_TYPE_FLOAT };
+	vector<ze_image_handle_t> images;
+	auto createImage = [&](uint32_t width, uint32_t height, const float *src) {
+		ze_image_handle_t hImage;
+		ze_image_desc_t image_desc = { ZE_STRUCTURE_TYPE_IMAGE_DESC,
+					       nullptr,
+					       ZE_IMAGE_FLAG_KERNEL_WRITE,
+					       ZE_IMAGE_TYPE_2D,
+					       img_fmt,
+					       width,
+					       height,
+					       0,
+					       0,
+					       0 };
+		CHECK(zeImageCreate(context, device, &image_desc, &hImage));
+		if (src != nullptr)
+			CHECK(zeCommandListAppendImageCopyFromMemory(commands, hImage, src, nullptr,
+								     nullptr, 0, nullptr));
+		images.push_back(hImage);
+		return hImage;
+	};
+
+	ze_device_mem_alloc_desc_t deviceMemDesc = {
+		ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC, nullptr, 0, 0
+	};
+	vector<void *> allocations;
+	auto createBuffer = [&](const float *src, size_t count) {
+		void *ptr = nullptr;
+		CHECK(zeMemAllocDevice(context, &deviceMemDesc, count * sizeof(float), 64, device,
+				       &ptr));
+		CHECK(zeCommandListAppendMemoryCopy(commands, ptr, src, count * sizeof(float),
+						    nullptr, 0, nullptr));
+		allocations.push_back(ptr);
+		return ptr;
+	};
+
+	// read in and initialize kernel
+	FILE *fp = fopen(KERNEL, "rb");
+	if (fp == nullptr) {
+		fprintf(stderr, "FAIL: unable to open %s\n", KERNEL);
+		exit(-1);
+	}
+	fseek(fp, 0, SEEK_END);
+	size_t sz = ftell(fp);
+	rewind(fp);
+
+	unsigned char *code = (unsigned char *)malloc(sz);
+	size_t ret = fread(code, 1, sz, fp);
+	if (ret != sz) {
+		if (feof(fp))
+			printf("Error reading kernel: unexpected end of file\n");
+		else if (ferror(fp)) {
+			perror("Error reading kernel\n");
+		}
+		fclose(fp);
+		exit(-1);
+	}
+	fclose(fp);
+
+	ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
+					nullptr,
+					ZE_MODULE_FORMAT_IL_SPIRV,
+					sz,
+					code,
+					"-vc-codegen",
+					nullptr };
+	CHECK(zeModuleCreate(context, device, &moduleDesc, &module, nullptr));
+
+	vector<ze_kernel_handle_t> kernels;
+	auto createKernel = [&](const char *name) {
+		ze_kernel_handle_t kernel;
+		ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0, name };
+		CHECK(zeKernelCreate(module, &kernelDesc, &kernel));
+		CHECK(zeKernelSetGroupSize(kernel, 1, 1, 1));
+		kernels.push_back(kernel);
+		return kernel;
+	};
+
+	auto launch = [&](ze_kernel_handle_t kernel, ze_group_count_t groupCount) {
+		double best = std::numeric_limits<double>::max();
+		for (int iter = 0; iter < nIterations; iter++) {
+			CHECK(zeCommandListAppendLaunchKernel(commands, kernel, &groupCount, hEvent,
+							      0, nullptr));
+			CHECK(zeEventHostSynchronize(hEvent, std::numeric_limits<uint64_t>::max()));
+			best = min(best, kernelTimeNs(hEvent, device_properties));
+			CHECK(zeEventHostReset(hEvent));
+		}
+		return best;
+	};
+
+	auto readImage = [&](float *dst, ze_image_handle_t hImage) {
+		CHECK(zeCommandListAppendImageCopyToMemory(commands, dst, hImage, nullptr, hEvent, 0,
+							   nullptr));
+		CHECK(zeEventHostSynchronize(hEvent, std::numeric_limits<uint64_t>::max()));
+		CHECK(zeEventHostReset(hEvent));
+	};
+
+	bool passed = true;
+	double img_bytes = 2.0 * img_w * img_h * sizeof(float);
+	ze_group_count_t tileCount = { (uint32_t)img_w / TILE_W, (uint32_t)img_h / TILE_H, 1 };
+
+	ze_image_handle_t hSrc = createImage(img_w, img_h, img.data());
+	ze_image_handle_t hTmp = createImage(img_w, img_h, nullptr);
+	ze_image_handle_t hDst = createImage(img_w, img_h, nullptr);
+	vector<float> ref(img_w * img_h), res(img_w * img_h);
+
+	printf("%dx%d image\n", img_w, img_h);
+	for (int K = 3; K <= 7; K += 2) {
+		char name[32];
+
+		/* generic K x K filter, padded to 16 floats for block reads */
+		vector<float> filter((K * K + 15) / 16 * 16, 0.0f);
+		for (int i = 0; i < K * K; i++)
+			filter[i] = randData(0.0f, 1.0f);
+		void *d_filter = createBuffer(filter.data(), filter.size());
+		sync();
+
+		snprintf(name, sizeof(name), "conv2d_%dx%d", K, K);
+		ze_kernel_handle_t kernel = createKernel(name);
+		CHECK(zeKernelSetArgumentValue(kernel, 0, sizeof(hSrc), &hSrc));
+		CHECK(zeKernelSetArgumentValue(kernel, 1, sizeof(d_filter), &d_filter));
+		CHECK(zeKernelSetArgumentValue(kernel, 2, sizeof(hDst), &hDst));
+		double t = launch(kernel, tileCount);
+		printf("%-14s %10.3f us %8.2f GB/s %8.2f GFLOPS\n", name, t / 1000.0,
+		       img_bytes / t, 2.0 * K * K * img_w * img_h / t);
+
+		conv2dRef(img.data(), ref.data(), img_w, img_h, filter.data(), K);
+		readImage(res.data(), hDst);
+		passed &= compare(ref.data(), res.data(), ref.size(), name);
+
+		/* separable K filter, row pass into hTmp then column pass */
+		vector<float> sep(16, 0.0f);
+		for (int i = 0; i < K; i++)
+			sep[i] = randData(0.0f, 1.0f);
+		void *d_sep = createBuffer(sep.data(), sep.size());
+		sync();
+
+		snprintf(name, sizeof(name), "sep_row_%d", K);
+		ze_kernel_handle_t row = createKernel(name);
+		CHECK(zeKernelSetArgumentValue(row, 0, sizeof(hSrc), &hSrc));
+		CHECK(zeKernelSetArgumentValue(row, 1, sizeof(d_sep), &d_sep));
+		CHECK(zeKernelSetArgumentValue(row, 2, sizeof(hTmp), &hTmp));
+		snprintf(name, sizeof(name), "sep_col_%d", K);
+		ze_kernel_handle_t col = createKernel(name);
+		CHECK(zeKernelSetArgumentValue(col, 0, sizeof(hTmp), &hTmp));
+		CHECK(zeKernelSetArgumentValue(col, 1, sizeof(d_sep), &d_sep));
+		CHECK(zeKernelSetArgumentValue(col, 2, sizeof(hDst), &hDst));
+		t = launch(row, tileCount) + launch(col, tileCount);
+		snprintf(name, sizeof(name), "separable_%d", K);
+		printf("%-14s %10.3f us %8.2f GB/s %8.2f GFLOPS\n", name, t / 1000.0,
+		       2.0 * img_bytes / t, 4.0 * K * img_w * img_h / t);
+
+		separableRef(img.data(), ref.data(), img_w, img_h, sep.data(), K);
+		readImage(res.data(), hDst);
+		passed &= compare(ref.data(), res.data(), ref.size(), name);
+	}
+
+	/* small CNN layer, 3x3 same convolution */
+	printf("conv %dx%d c_in=%d c_out=%d\n", cnn_w, cnn_h, c_in, c_out);
+	vector<float> cnn_ref(c_out * cnn_h * cnn_w);
+	convNchwRef(act.data(), cnn_ref.data(), weights.data(), c_in, c_out, cnn_w, cnn_h);
+	double cnn_flops = 2.0 * 9 * c_in * c_out * cnn_w * cnn_h;
+
+	/* NCHW: zero bordered planes stacked vertically, 3x3 filters padded to 16 */
+	int pw = cnn_w + 2, ph = cnn_h + 2;
+	vector<float> nchw(c_in * ph * pw, 0.0f);
+	for (int ic = 0; ic < c_in; ic++)
+		for (int y = 0; y < cnn_h; y++)
+			for (int x = 0; x < cnn_w; x++)
+				nchw[(ic * ph + y + 1) * pw + x + 1] = act[(ic * cnn_h + y) * cnn_w + x];
+	vector<float> oihw16(c_out * c_in * 16, 0.0f);
+	for (int f = 0; f < c_out * c_in; f++)
+		for (int i = 0; i < 9; i++)
+			oihw16[f * 16 + i] = weights[f * 9 + i];
+
+	ze_image_handle_t hActNchw = createImage(pw, c_in * ph, nchw.data());
+	ze_image_handle_t hOutNchw = createImage(cnn_w, c_out * cnn_h, nullptr);
+	void *d_oihw = createBuffer(oihw16.data(), oihw16.size());
+	sync();
+
+	ze_kernel_handle_t k_nchw = createKernel("conv_nchw_3x3");
+	CHECK(zeKernelSetArgumentValue(k_nchw, 0, sizeof(c_in), &c_in));
+	CHECK(zeKernelSetArgumentValue(k_nchw, 1, sizeof(cnn_h), &cnn_h));
+	CHECK(zeKernelSetArgumentValue(k_nchw, 2, sizeof(hActNchw), &hActNchw));
+	CHECK(zeKernelSetArgumentValue(k_nchw, 3, sizeof(d_oihw), &d_oihw));
+	CHECK(zeKernelSetArgumentValue(k_nchw, 4, sizeof(hOutNchw), &hOutNchw));
+	double t = launch(k_nchw, { (uint32_t)cnn_w / TILE_W, (uint32_t)cnn_h / TILE_H,
+				    (uint32_t)c_out });
+	printf("%-14s %10.3f us %8.2f GFLOPS\n", "conv_nchw_3x3", t / 1000.0, cnn_flops / t);
+
+	vector<float> cnn_res(cnn_ref.size());
+	readImage(cnn_res.data(), hOutNchw);
+	passed &= compare(cnn_ref.data(), cnn_res.data(), cnn_ref.size(), "conv_nchw_3x3");
+
+	/* NHWC: zero bordered rows of pixels, weights in HWIO */
+	vector<float> nhwc(ph * pw * c_in, 0.0f);
+	for (int ic = 0; ic < c_in; ic++)
+		for (int y = 0; y < cnn_h; y++)
+			for (int x = 0; x < cnn_w; x++)
+				nhwc[((y + 1) * pw + x + 1) * c_in + ic] =
+					act[(ic * cnn_h + y) * cnn_w + x];
+	vector<float> hwio(9 * c_in * c_out);
+	for (int oc = 0; oc < c_out; oc++)
+		for (int ic = 0; ic < c_in; ic++)
+			for (int i = 0; i < 9; i++)
+				hwio[(i * c_in + ic) * c_out + oc] = weights[(oc * c_in + ic) * 9 + i];
+
+	ze_image_handle_t hActNhwc = createImage(pw * c_in, ph, nhwc.data());
+	ze_image_handle_t hOutNhwc = createImage(cnn_w * c_out, cnn_h, nullptr);
+	void *d_hwio = createBuffer(hwio.data(), hwio.size());
+	sync();
+
+	ze_kernel_handle_t k_nhwc = createKernel("conv_nhwc_3x3");
+	CHECK(zeKernelSetArgumentValue(k_nhwc, 0, sizeof(c_in), &c_in));
+	CHECK(zeKernelSetArgumentValue(k_nhwc, 1, sizeof(c_out), &c_out));
+	CHECK(zeKernelSetArgumentValue(k_nhwc, 2, sizeof(hActNhwc), &hActNhwc));
+	CHECK(zeKernelSetArgumentValue(k_nhwc, 3, sizeof(d_hwio), &d_hwio));
+	CHECK(zeKernelSetArgumentValue(k_nhwc, 4, sizeof(hOutNhwc), &hOutNhwc));
+	t = launch(k_nhwc, { (uint32_t)cnn_w / NHWC_PIX, (uint32_t)cnn_h, (uint32_t)c_out / NHWC_OC });
+	printf("%-14s %10.3f us %8.2f GFLOPS\n", "conv_nhwc_3x3", t / 1000.0, cnn_flops / t);
+
+	readImage(cnn_res.data(), hOutNhwc);
+	vector<float> nhwc_ref(cnn_ref.size());
+	for (int oc = 0; oc < c_out; oc++)
+		for (int p = 0; p < cnn_h * cnn_w; p++)
+			nhwc_ref[p * c_out + oc] = cnn_ref[oc * cnn_h * cnn_w + p];
+	passed &= compare(nhwc_ref.data(), cnn_res.data(), nhwc_ref.size(), "conv_nhwc_3x3");
+
+	printf(passed ? "GPU stencil test PASSED\n" : "GPU stencil test FAILED\n");
+
+	for (auto kernel : kernels)
+		zeKernelDestroy(kernel);
+	for (auto hImage : images)
+		zeImageDestroy(hImage);
+	for (auto ptr : allocations)
+		CHECK(zeMemFree(context, ptr));
+
+	zeEventDestroy(hEvent);
+	zeEventPoolDestroy(hPool);
+	zeModuleDestroy(module);
+	zeCommandListDestroy(commands);
+	zeContextDestroy(context);
+
+	printf("done\n");
+
+	return passed ? 0 : -1;
+}
@@ -0,0 +1,226 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <cm/cm.h>
+
+// every thread computes one TILE_H x TILE_W output tile from a halo padded
+// block that is read once. Media block reads clamp out of bound coordinates
+// to the image edge, which gives the clamp-to-edge border of the 2D filters.
+#define TILE_W 8
+#define TILE_H 8
+#define ROUND_UP(x, a) (((x) + (a)-1) / (a) * (a))
+
+// dst := src (*) filter, filter is K x K row major, padded to 16 floats
+template <int K>
+inline _GENX_ void conv2d_tile(SurfaceIndex src, SurfaceIndex filter, SurfaceIndex dst)
+{
+	const int R = K / 2;
+	const int KK = ROUND_UP(K * K, 16);
+	const int HALO_ROWS = ROUND_UP(TILE_H + K - 1, 4);
+
+	int x0 = cm_group_id(0) * TILE_W;
+	int y0 = cm_group_id(1) * TILE_H;
+
+	vector<float, KK> w;
+#pragma unroll
+	for (int i = 0; i < KK; i += 16)
+		read(filter, i * sizeof(float), w.select<16, 1>(i));
+
+	matrix<float, HALO_ROWS, 16> in;
+#pragma unroll
+	for (int r = 0; r < HALO_ROWS; r += 4)
+		read(src, (x0 - R) * sizeof(float), y0 - R + r, in.select<4, 1, 16, 1>(r, 0));
+
+	matrix<float, TILE_H, TILE_W> out = 0.0f;
+#pragma unroll
+	for (int dy = 0; dy < K; dy++)
+#pragma unroll
+		for (int dx = 0; dx < K; dx++)
+			out += w(dy * K + dx) * in.select<TILE_H, 1, TILE_W, 1>(dy, dx);
+
+	write(dst, x0 * sizeof(float), y0, out);
+}
+
+// horizontal pass of a separable filter, filter is K floats padded to 16
+template <int K>
+inline _GENX_ void sep_row_tile(SurfaceIndex src, SurfaceIndex filter, SurfaceIndex dst)
+{
+	const int R = K / 2;
+
+	int x0 = cm_group_id(0) * TILE_W;
+	int y0 = cm_group_id(1) * TILE_H;
+
+	vector<float, 16> w;
+	read(filter, 0, w);
+
+	matrix<float, TILE_H, 16> in;
+	read(src, (x0 - R) * sizeof(float), y0, in.select<4, 1, 16, 1>(0, 0));
+	read(src, (x0 - R) * sizeof(float), y0 + 4, in.select<4, 1, 16, 1>(4, 0));
+
+	matrix<float, TILE_H, TILE_W> out = 0.0f;
+#pragma unroll
+	for (int dx = 0; dx < K; dx++)
+		out += w(dx) * in.select<TILE_H, 1, TILE_W, 1>(0, dx);
+
+	write(dst, x0 * sizeof(float), y0, out);
+}
+
+// vertical pass of a separable filter, filter is K floats padded to 16
+template <int K>
+inline _GENX_ void sep_col_tile(SurfaceIndex src, SurfaceIndex filter, SurfaceIndex dst)
+{
+	const int R = K / 2;
+	const int HALO_ROWS = ROUND_UP(TILE_H + K - 1, 8);
+
+	int x0 = cm_group_id(0) * TILE_W;
+	int y0 = cm_group_id(1) * TILE_H;
+
+	vector<float, 16> w;
+	read(filter, 0, w);
+
+	matrix<float, HALO_ROWS, TILE_W> in;
+#pragma unroll
+	for (int r = 0; r < HALO_ROWS; r += 8)
+		read(src, x0 * sizeof(float), y0 - R + r, in.select<8, 1, TILE_W, 1>(r, 0));
+
+	matrix<float, TILE_H, TILE_W> out = 0.0f;
+#pragma unroll
+	for (int dy = 0; dy < K; dy++)
+		out += w(dy) * in.select<TILE_H, 1, TILE_W, 1>(dy, 0);
+
+	write(dst, x0 * sizeof(float), y0, out);
+}
+
+#define CONV2D_KERNEL(K)                                                                     \
+	extern "C" _GENX_MAIN_ void conv2d_##K##x##K(                                        \
+		SurfaceIndex src [[type("image2d_t float")]],                                \
+		SurfaceIndex filter [[type("buffer_t")]],                                    \
+		SurfaceIndex dst [[type("image2d_t float")]])                                \
+	{                                                                                    \
+		conv2d_tile<K>(src, filter, dst);                                            \
+	}
+
+#define SEPARABLE_KERNELS(K)                                                                 \
+	extern "C" _GENX_MAIN_ void sep_row_##K(SurfaceIndex src [[type("image2d_t float")]], \
+						SurfaceIndex filter [[type("buffer_t")]],    \
+						SurfaceIndex dst [[type("image2d_t float")]]) \
+	{                                                                                    \
+		sep_row_tile<K>(src, filter, dst);                                           \
+	}                                                                                    \
+	extern "C" _GENX_MAIN_ void sep_col_##K(SurfaceIndex src [[type("image2d_t float")]], \
+						SurfaceIndex filter [[type("buffer_t")]],    \
+						SurfaceIndex dst [[type("image2d_t float")]]) \
+	{                                                                                    \
+		sep_col_tile<K>(src, filter, dst);                                           \
+	}
+
+#ifndef __INTELLISENSE__
+CONV2D_KERNEL(3)
+CONV2D_KERNEL(5)
+CONV2D_KERNEL(7)
+SEPARABLE_KERNELS(3)
+SEPARABLE_KERNELS(5)
+SEPARABLE_KERNELS(7)
+#endif
+
+// 3x3 stride 1 direct convolution, NCHW
+// src holds c_in planes of (h + 2) x (w + 2) with a zero border stacked
+// vertically, dst holds c_out planes of h x w, weights are OIHW with every
+// 3x3 filter padded to 16 floats. The halo block of a plane is read once per
+// input channel and reused for all 9 taps. h and w are multiples of 8.
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+conv_nchw_3x3(int c_in, int h,
+	      SurfaceIndex src [[type("image2d_t float")]],
+	      SurfaceIndex weights [[type("buffer_t")]],
+	      SurfaceIndex dst [[type("image2d_t float")]])
+{
+	int x0 = cm_group_id(0) * TILE_W;
+	int y0 = cm_group_id(1) * TILE_H;
+	int oc = cm_group_id(2);
+
+	matrix<float, TILE_H, TILE_W> out = 0.0f;
+	for (int ic = 0; ic < c_in; ic++) {
+		vector<float, 16> w;
+		read(weights, (oc * c_in + ic) * 16 * sizeof(float), w);
+
+		matrix<float, 12, 16> in;
+		int plane_y = ic * (h + 2) + y0;
+#pragma unroll
+		for (int r = 0; r < 12; r += 4)
+			read(src, x0 * sizeof(float), plane_y + r, in.select<4, 1, 16, 1>(r, 0));
+
+#pragma unroll
+		for (int dy = 0; dy < 3; dy++)
+#pragma unroll
+			for (int dx = 0; dx < 3; dx++)
+				out += w(dy * 3 + dx) * in.select<TILE_H, 1, TILE_W, 1>(dy, dx);
+	}
+
+	write(dst, x0 * sizeof(float), oc * h + y0, out);
+}
+
+#define NHWC_PIX 4
+#define NHWC_IC 8
+#define NHWC_OC 16
+
+// 3x3 stride 1 direct convolution, NHWC
+// src is (h + 2) rows of (w + 2) * c_in floats with a zero border, dst is h
+// rows of w * c_out floats, weights are HWIO. A thread computes NHWC_PIX
+// pixels of one row for NHWC_OC output channels: for every chunk of NHWC_IC
+// input channels it reads the 3 x (NHWC_PIX + 2) pixel halo once and
+// accumulates it against the 3x3 x NHWC_IC x NHWC_OC weight block.
+// w is a multiple of NHWC_PIX, c_in of NHWC_IC and c_out of NHWC_OC.
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+conv_nhwc_3x3(int c_in, int c_out,
+	      SurfaceIndex src [[type("image2d_t float")]],
+	      SurfaceIndex weights [[type("buffer_t")]],
+	      SurfaceIndex dst [[type("image2d_t float")]])
+{
+	int x0 = cm_group_id(0) * NHWC_PIX;
+	int y0 = cm_group_id(1);
+	int oc0 = cm_group_id(2) * NHWC_OC;
+
+	matrix<float, NHWC_PIX, NHWC_OC> out = 0.0f;
+	for (int ic0 = 0; ic0 < c_in; ic0 += NHWC_IC) {
+		matrix<float, 3, (NHWC_PIX + 2) * NHWC_IC> in;
+#pragma unroll
+		for (int p = 0; p < NHWC_PIX + 2; p++)
+			read(src, ((x0 + p) * c_in + ic0) * sizeof(float), y0,
+			     in.select<3, 1, NHWC_IC, 1>(0, p * NHWC_IC));
+
+#pragma unroll
+		for (int dy = 0; dy < 3; dy++) {
+#pragma unroll
+			for (int dx = 0; dx < 3; dx++) {
+				matrix<float, NHWC_IC, NHWC_OC> w;
+				uint32_t w_off = ((dy * 3 + dx) * c_in + ic0) * c_out + oc0;
+#pragma unroll
+				for (int i = 0; i < NHWC_IC; i++)
+					read(weights, (w_off + i * c_out) * sizeof(float), w.row(i));
+
+#pragma unroll
+				for (int p = 0; p < NHWC_PIX; p++)
+#pragma unroll
+					for (int i = 0; i < NHWC_IC; i++)
+						out.row(p) += in(dy, (p + dx) * NHWC_IC + i) * w.row(i);
+			}
+		}
+	}
+
+#pragma unroll
+	for (int p = 0; p < NHWC_PIX; p++)
+		write(dst, ((x0 + p) * c_out + oc0) * sizeof(float), y0, out.row(p));
+}
@@ -0,0 +1,435 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <iostream>
+#include <cassert>
+#include <math.h>
+#include <vector>
+
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include <level_zero/ze_api.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+#include "ze_batch.h"
+#include "ze_pool.h"
+
+using namespace std;
+
+#define KERNEL_SZ 16
+#define CHECK(a)                                                              \
+	do {                                                                  \
+		auto err = (a);                                               \
+		if (err != 0) {                                               \
+			fprintf(stderr, "FAIL: err=%d @ line=%d (%s)\n", err, \
+				__LINE__, (#a));                              \
+			exit(err);                                            \
+		}                                                             \
+	} while (0)
+#define CHECK2(a, msg)                                                      \
+	do {                                                                \
+		if ((a)) {                                                  \
+			fprintf(stderr, "FAIL: @ line=%d (%s)\n", __LINE__, \
+				(msg));                                     \
+			exit(-1);                                           \
+		}                                                           \
+	} while (0)
+#ifndef KERNEL
+#error "Error: KERNEL must be defined with location of kernel binary"
+#endif
+
+/* largest request in KERNEL_SZ chunks, 4096 chunks are 256 KiB per buffer */
+#define MAX_CHUNKS 4096
+/* every IMAGE_EVERY-th request also round trips a 2D image */
+#define IMAGE_EVERY 4
+
+struct Worker {
+	ze_command_list_handle_t commands;
+	ze_kernel_handle_t kernel;
+	ze_event_pool_handle_t hPool;
+	ze_event_handle_t hEvent;
+	vector<double> latency;
+	bool failed;
+};
+
+// one request of the serving loop: temporaries are allocated, c = a + b is
+// computed and checked, and everything is released again; with a batcher
+// the request is handed to it instead and coalesced with the other threads'
+struct Serving {
+	ze_context_handle_t context;
+	ze_device_handle_t device;
+	ZePool *device_pool;
+	ZePool *host_pool;
+	ZeImageCache *images;
+	ZeBatcher *batcher;
+
+	void *deviceAlloc(size_t bytes)
+	{
+		if (device_pool != nullptr)
+			return device_pool->alloc(bytes);
+		void *ptr = nullptr;
+		ze_device_mem_alloc_desc_t desc = { ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC,
+						    nullptr, 0, 0 };
+		CHECK(zeMemAllocDevice(context, &desc, bytes, 64, device, &ptr));
+		return ptr;
+	}
+
+	void *hostAlloc(size_t bytes)
+	{
+		if (host_pool != nullptr)
+			return host_pool->alloc(bytes);
+		void *ptr = nullptr;
+		ze_host_mem_alloc_desc_t desc = { ZE_STRUCTURE_TYPE_HOST_MEM_ALLOC_DESC, nullptr, 0 };
+		CHECK(zeMemAllocHost(context, &desc, bytes, 64, &ptr));
+		return ptr;
+	}
+
+	void deviceFree(void *ptr, size_t bytes)
+	{
+		if (device_pool != nullptr)
+			device_pool->free(ptr, bytes);
+		else
+			CHECK(zeMemFree(context, ptr));
+	}
+
+	void hostFree(void *ptr, size_t bytes)
+	{
+		if (host_pool != nullptr)
+			host_pool->free(ptr, bytes);
+		else
+			CHECK(zeMemFree(context, ptr));
+	}
+
+	ze_image_handle_t imageAcquire(const ze_image_desc_t &desc)
+	{
+		if (images != nullptr)
+			return images->acquire(desc);
+		ze_image_handle_t hImage;
+		CHECK(zeImageCreate(context, device, &desc, &hImage));
+		return hImage;
+	}
+
+	void imageRelease(ze_image_handle_t hImage)
+	{
+		if (images != nullptr)
+			images->release(hImage);
+		else
+			CHECK(zeImageDestroy(hImage));
+	}
+
+	void sync(Worker &w)
+	{
+		CHECK(zeCommandListAppendBarrier(w.commands, w.hEvent, 0, nullptr));
+		CHECK(zeEventHostSynchronize(w.hEvent, std::numeric_limits<uint64_t>::max()));
+		CHECK(zeEventHostReset(w.hEvent));
+	}
+
+	void batched(Worker &w, unsigned chunks)
+	{
+		size_t count = chunks * KERNEL_SZ;
+		vector<int> src1(count), src2(count), dst(count);
+
+		for (size_t i = 0; i < count; i++) {
+			src1[i] = i;
+			src2[i] = chunks;
+		}
+		batcher->submit(src1.data(), src2.data(), dst.data(), count * sizeof(int)).wait();
+
+		for (size_t i = 0; i < count; i++) {
+			if (dst[i] != (int)i + (int)chunks) {
+				fprintf(stderr, "FAIL: comparison at index[%zu] of %zu\n", i, count);
+				w.failed = true;
+				break;
+			}
+		}
+	}
+
+	void request(Worker &w, unsigned chunks, bool with_image)
+	{
+		if (batcher != nullptr) {
+			batched(w, chunks);
+			return;
+		}
+
+		size_t count = chunks * KERNEL_SZ;
+		size_t bytes = count * sizeof(int);
+
+		int *src1 = (int *)hostAlloc(bytes);
+		int *src2 = (int *)hostAlloc(bytes);
+		int *dst = (int *)hostAlloc(bytes);
+		void *d_a = deviceAlloc(bytes);
+		void *d_b = deviceAlloc(bytes);
+		void *d_c = deviceAlloc(bytes);
+
+		for (size_t i = 0; i < count; i++) {
+			src1[i] = i;
+			src2[i] = chunks;
+		}
+
+		CHECK(zeCommandListAppendMemoryCopy(w.commands, d_a, src1, bytes, nullptr, 0,
+						    nullptr));
+		CHECK(zeCommandListAppendMemoryCopy(w.commands, d_b, src2, bytes, nullptr, 0,
+						    nullptr));
+		CHECK(zeCommandListAppendBarrier(w.commands, nullptr, 0, nullptr));
+
+		CHECK(zeKernelSetArgumentValue(w.kernel, 0, sizeof(d_a), &d_a));
+		CHECK(zeKernelSetArgumentValue(w.kernel, 1, sizeof(d_b), &d_b));
+		CHECK(zeKernelSetArgumentValue(w.kernel, 2, sizeof(d_c), &d_c));
+		ze_group_count_t groupCount = { chunks, 1, 1 };
+		CHECK(zeCommandListAppendLaunchKernel(w.commands, w.kernel, &groupCount, nullptr, 0,
+						      nullptr));
+		CHECK(zeCommandListAppendBarrier(w.commands, nullptr, 0, nullptr));
+		CHECK(zeCommandListAppendMemoryCopy(w.commands, dst, d_c, bytes, nullptr, 0,
+						    nullptr));
+
+		/* the per run images of test_3: chunks x KERNEL_SZ floats */
+		ze_image_handle_t hImage = nullptr;
+		if (with_image) {
+			ze_image_desc_t desc = { ZE_STRUCTURE_TYPE_IMAGE_DESC,
+						 nullptr,
+						 ZE_IMAGE_FLAG_KERNEL_WRITE,
+						 ZE_IMAGE_TYPE_2D,
+						 { ZE_IMAGE_FORMAT_LAYOUT_32, ZE_IMAGE_FORMAT_TYPE_FLOAT },
+						 KERNEL_SZ,
+						 chunks,
+						 0,
+						 0,
+						 0 };
+			hImage = imageAcquire(desc);
+			CHECK(zeCommandListAppendImageCopyFromMemory(w.commands, hImage, src1,
+								     nullptr, nullptr, 0, nullptr));
+			CHECK(zeCommandListAppendBarrier(w.commands, nullptr, 0, nullptr));
+			CHECK(zeCommandListAppendImageCopyToMemory(w.commands, src2, hImage, nullptr,
+								   nullptr, 0, nullptr));
+		}
+		sync(w);
+
+		for (size_t i = 0; i < count; i++) {
+			if (dst[i] != (int)i + (int)chunks ||
+			    (with_image && src2[i] != src1[i])) {
+				fprintf(stderr, "FAIL: comparison at index[%zu] of %zu\n", i, count);
+				w.failed = true;
+				break;
+			}
+		}
+
+		if (hImage != nullptr)
+			imageRelease(hImage);
+		deviceFree(d_a, bytes);
+		deviceFree(d_b, bytes);
+		deviceFree(d_c, bytes);
+		hostFree(src1, bytes);
+		hostFree(src2, bytes);
+		hostFree(dst, bytes);
+	}
+};
+
+static double percentile(vector<double> &v, double p)
+{
+	if (v.empty())
+		return 0.0;
+	sort(v.begin(), v.end());
+	return v[min(v.size() - 1, (size_t)(p * v.size()))];
+}
+
+int main(int argc, char *argv[])
+{
+	int nRequests = 2000;
+	unsigned nThreads = 4;
+
+	if (argc > 1)
+		nRequests = atoi(argv[1]);
+	if (argc > 2)
+		nThreads = max(1, atoi(argv[2]));
+
+	// initialize GPU
+	ze_driver_handle_t driver = nullptr;
+	ze_device_handle_t device = nullptr;
+	ze_context_handle_t context = nullptr;
+	ze_module_handle_t module;
+
+	CHECK(zeInit(ZE_INIT_FLAG_GPU_ONLY));
+
+	// Discover all the driver instances
+	uint32_t driverCount = 0;
+	CHECK(zeDriverGet(&driverCount, nullptr));
+	CHECK2((driverCount == 0), "unable to locate driver(s)");
+
+	ze_driver_handle_t *allDrivers =
+		(ze_driver_handle_t *)malloc(driverCount * sizeof(*allDrivers));
+	CHECK(zeDriverGet(&driverCount, allDrivers));
+
+	// Find a driver instance with a GPU device
+	for (uint32_t i = 0; i < driverCount; ++i) {
+		uint32_t deviceCount = 0;
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, nullptr));
+		if (deviceCount == 0)
+			continue;
+		ze_device_handle_t *allDevices = (ze_device_handle_t *)malloc(
+			deviceCount * sizeof(ze_device_handle_t));
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, allDevices));
+		for (uint32_t d = 0; d < deviceCount; ++d) {
+			ze_device_properties_t device_properties;
+			CHECK(zeDeviceGetProperties(allDevices[d],
+						    &device_properties));
+			if (ZE_DEVICE_TYPE_GPU == device_properties.type) {
+				fprintf(stderr,
+					"INFO: GPU device located driver=%d, device=%d\n",
+					i, d);
+				driver = allDrivers[i];
+				device = allDevices[d];
+				break;
+			}
+		}
+		if (nullptr != device)
+			break;
+	}
+	CHECK2((driver == nullptr), "unable to locate driver with GPU device");
+	CHECK2((device == nullptr), "unable to locate GPU device");
+
+	ze_context_desc_t contextDesc = { ZE_STRUCTURE_TYPE_CONTEXT_DESC,
+					  nullptr, 0 };
+	CHECK(zeContextCreate(driver, &contextDesc, &context));
+
+	// read in and initialize kernel
+	FILE *fp = fopen(KERNEL, "rb");
+	if (fp == nullptr) {
+		fprintf(stderr, "FAIL: unable to open %s\n", KERNEL);
+		exit(-1);
+	}
+	fseek(fp, 0, SEEK_END);
+	size_t sz = ftell(fp);
+	rewind(fp);
+
+	unsigned char *code = (unsigned char *)malloc(sz);
+	size_t ret = fread(code, 1, sz, fp);
+	if (ret != sz) {
+		if (feof(fp))
+			printf("Error reading kernel: unexpected end of file\n");
+		else if (ferror(fp)) {
+			perror("Error reading kernel\n");
+		}
+		fclose(fp);
+		exit(-1);
+	}
+	fclose(fp);
+
+	ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
+					nullptr,
+					ZE_MODULE_FORMAT_IL_SPIRV,
+					sz,
+					code,
+					"-vc-codegen",
+					nullptr };
+	CHECK(zeModuleCreate(context, device, &moduleDesc, &module, nullptr));
+
+	/* kernel arguments are per handle, every worker gets its own */
+	vector<Worker> workers(nThreads);
+	for (auto &w : workers) {
+		ze_command_queue_desc_t commandQueueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
+							     nullptr,
+							     0,
+							     0,
+							     0,
+							     ZE_COMMAND_QUEUE_MODE_DEFAULT,
+							     ZE_COMMAND_QUEUE_PRIORITY_NORMAL };
+		CHECK(zeCommandListCreateImmediate(context, device, &commandQueueDesc, &w.commands));
+
+		ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0,
+						"vector_add" };
+		CHECK(zeKernelCreate(module, &kernelDesc, &w.kernel));
+		CHECK(zeKernelSetGroupSize(w.kernel, 1, 1, 1));
+
+		ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
+						   ZE_EVENT_POOL_FLAG_HOST_VISIBLE, 1 };
+		CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &w.hPool));
+		ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, 0,
+					 ZE_EVENT_SCOPE_FLAG_HOST, ZE_EVENT_SCOPE_FLAG_HOST };
+		CHECK(zeEventCreate(w.hPool, &desc, &w.hEvent));
+	}
+
+	bool passed = true;
+	auto serve = [&](const char *name, Serving &s) {
+		auto t0 = chrono::steady_clock::now();
+		vector<thread> threads;
+		for (unsigned t = 0; t < nThreads; t++) {
+			threads.emplace_back([&, t]() {
+				Worker &w = workers[t];
+				unsigned seed = t + 1;
+				w.latency.clear();
+				w.failed = false;
+				for (int r = t; r < nRequests; r += nThreads) {
+					unsigned chunks = 1 + rand_r(&seed) % MAX_CHUNKS;
+					auto r0 = chrono::steady_clock::now();
+					s.request(w, chunks, r % IMAGE_EVERY == 0);
+					auto r1 = chrono::steady_clock::now();
+					w.latency.push_back(
+						chrono::duration<double, micro>(r1 - r0).count());
+				}
+			});
+		}
+		for (auto &th : threads)
+			th.join();
+		auto t1 = chrono::steady_clock::now();
+
+		vector<double> all;
+		for (auto &w : workers) {
+			all.insert(all.end(), w.latency.begin(), w.latency.end());
+			passed &= !w.failed;
+		}
+		double total = chrono::duration<double, milli>(t1 - t0).count();
+		printf("%-8s %d requests on %u threads: %.1f ms, p50 %.1f us, p99 %.1f us, "
+		       "max %.1f us\n",
+		       name, nRequests, nThreads, total, percentile(all, 0.50),
+		       percentile(all, 0.99), percentile(all, 1.0));
+	};
+
+	Serving raw = { context, device, nullptr, nullptr, nullptr, nullptr };
+	serve("driver", raw);
+
+	{
+		ZePool device_pool(context, device, ZE_POOL_DEVICE);
+		ZePool host_pool(context, device, ZE_POOL_HOST);
+		ZeImageCache images(context, device);
+		Serving pooled = { context, device, &device_pool, &host_pool, &images, nullptr };
+		serve("pooled", pooled);
+
+		device_pool.printStats("device pool");
+		host_pool.printStats("host pool");
+		images.printStats("image cache");
+	}
+
+	{
+		/* requests of all threads share uploads, launches and downloads */
+		ZeBatcher batcher(context, device, module, "vector_add", KERNEL_SZ * sizeof(int));
+		Serving batched = { context, device, nullptr, nullptr, nullptr, &batcher };
+		serve("batched", batched);
+
+		batcher.printStats("batcher");
+	}
+
+	for (auto &w : workers) {
+		zeEventDestroy(w.hEvent);
+		zeEventPoolDestroy(w.hPool);
+		zeKernelDestroy(w.kernel);
+		zeCommandListDestroy(w.commands);
+	}
+	zeModuleDestroy(module);
+	zeContextDestroy(context);
+
+	fprintf(stderr, passed ? "PASSED\n" : "FAILED\n");
+	return passed ? 0 : -1;
+}
@@ -0,0 +1,32 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <cm/cm.h>
+
+#define SZ 16
+
+// c := a + b, every thread adds SZ ints
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+vector_add(SurfaceIndex isurface1 [[type("buffer_t")]],
+	   SurfaceIndex isurface2 [[type("buffer_t")]],
+	   SurfaceIndex osurface [[type("buffer_t")]])
+{
+	vector<int, SZ> ivector1;
+	vector<int, SZ> ivector2;
+	vector<int, SZ> ovector;
+
+	unsigned offset = sizeof(unsigned) * SZ * cm_group_id(0);
+	read(isurface1, offset, ivector1);
+	read(isurface2, offset, ivector2);
+	ovector = ivector1 + ivector2;
+	write(osurface, offset, ovector);
+}
@@ -0,0 +1,506 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "ze_devices.h"
+
+#include <gsl/gsl_cblas.h>
+#include <algorithm>
+
+using namespace std;
+
+#define CHECK(a)                                                              \
+	do {                                                                  \
+		auto err = (a);                                               \
+		if (err != 0) {                                               \
+			fprintf(stderr, "FAIL: err=%d @ line=%d (%s)\n", err, \
+				__LINE__, (#a));                              \
+			exit(err);                                            \
+		}                                                             \
+	} while (0)
+#define CHECK2(a, msg)                                                      \
+	do {                                                                \
+		if ((a)) {                                                  \
+			fprintf(stderr, "FAIL: @ line=%d (%s)\n", __LINE__, \
+				(msg));                                     \
+			exit(-1);                                           \
+		}                                                           \
+	} while (0)
+#ifndef KERNEL
+#error "Error: KERNEL must be defined with location of kernel binary"
+#endif
+
+#define KERNEL_ALIGN 16LLU
+/* @a is a power of 2 value */
+#define __ALIGN_KERNEL_MASK(x, mask) (((x) + (mask)) & ~(mask))
+#define __ALIGN_KERNEL(x, a) __ALIGN_KERNEL_MASK(x, (typeof(x))(a)-1)
+#define ALIGN(x, a) __ALIGN_KERNEL((x), (a))
+
+/* ints per vector_add_part thread */
+#define CHUNK 16
+
+static float randData(float low, float high)
+{
+	float t = (float)rand() / (float)RAND_MAX;
+	return (1.0f - t) * low + t * high;
+}
+
+class Matrix {
+	float *M;
+	uint32_t nrows;
+	uint32_t nrows_aligned;
+	uint32_t ncols;
+	uint32_t ncols_aligned;
+
+    public:
+	float &operator()(int r, int c)
+	{
+		return M[r * ncols_aligned + c];
+	}
+
+	Matrix(uint32_t rows, uint32_t cols, bool init)
+	{
+		this->nrows = rows;
+		this->nrows_aligned = ALIGN(this->nrows, KERNEL_ALIGN);
+		this->ncols = cols;
+		this->ncols_aligned = ALIGN(this->ncols, KERNEL_ALIGN);
+
+		size_t size = sizeof(float) * this->nrows_aligned * this->ncols_aligned;
+
+		M = (float *)aligned_alloc(4096, size);
+		/* kernels walk k in steps of 16, padding must not add to the sum */
+		memset(M, 0, size);
+
+		if (init)
+			for (int i = 0; i < rows; i++)
+				for (int j = 0; j < cols; j++)
+					(*this)(i, j) = randData(0.0f, 1.0f);
+	}
+
+	Matrix(Matrix &m)
+		: nrows(m.nrows)
+		, nrows_aligned(m.nrows_aligned)
+		, ncols(m.ncols)
+		, ncols_aligned(m.ncols_aligned)
+	{
+		size_t size = sizeof(float) * this->nrows_aligned * this->ncols_aligned;
+
+		M = (float *)aligned_alloc(4096, size);
+		memcpy(M, m.M, size);
+	}
+
+#define CORRECTNESS_THRESHOLD 0.00002
+	bool operator==(Matrix &m)
+	{
+		double max_relerror = 0.0;
+		for (int r = 0; r < nrows; r++)
+			for (int c = 0; c < ncols; c++) {
+				double relerror = fabs((*this)(r, c) - m(r, c)) /
+						  max(fabs((*this)(r, c)), fabs(m(r, c)));
+				max_relerror = max(max_relerror, relerror);
+				if (relerror > CORRECTNESS_THRESHOLD) {
+					printf("Failure %f %f relerror: %lf at [%d, %d]\n",
+					       (*this)(r, c), m(r, c), relerror, r, c);
+					return false;
+				}
+			}
+		printf("max_relerror = %e\n", max_relerror);
+		return true;
+	}
+
+	uint32_t rows()
+	{
+		return nrows;
+	};
+	uint32_t cols()
+	{
+		return ncols;
+	};
+	uint32_t ld()
+	{
+		return ncols_aligned;
+	}
+	float *data()
+	{
+		return M;
+	}
+
+	~Matrix()
+	{
+		free(M);
+	}
+};
+
+static double kernelTimeNs(ze_event_handle_t hEvent, ze_device_properties_t &props)
+{
+	ze_kernel_timestamp_result_t ts;
+	CHECK(zeEventQueryKernelTimestamp(hEvent, &ts));
+
+	uint64_t mask = props.kernelTimestampValidBits >= 64 ?
+				~0ULL :
+				(1ULL << props.kernelTimestampValidBits) - 1;
+	uint64_t cycles = (ts.context.kernelEnd - ts.context.kernelStart) & mask;
+	/* timerResolution is in ns per cycle */
+	return cycles * (double)props.timerResolution;
+}
+
+static vector<unsigned char> readKernel(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == nullptr) {
+		fprintf(stderr, "FAIL: unable to open %s\n", path);
+		exit(-1);
+	}
+	fseek(fp, 0, SEEK_END);
+	vector<unsigned char> code(ftell(fp));
+	rewind(fp);
+	size_t ret = fread(code.data(), 1, code.size(), fp);
+	fclose(fp);
+	CHECK2(ret != code.size(), "Error reading kernel");
+	return code;
+}
+
+// one leaf device (GPU or tile) with its own queue, module and copies of
+// the operands; it computes the block [start, start + size) of the output
+struct Part {
+	ze_device_handle_t device;
+	ze_device_properties_t props;
+	ze_command_list_handle_t commands;
+	ze_event_pool_handle_t pool;
+	ze_event_handle_t event;
+	ze_module_handle_t module;
+	ze_kernel_handle_t gemm;
+	ze_kernel_handle_t add;
+
+	ze_image_handle_t A, B, C;
+	void *a, *b, *c;
+
+	uint32_t start;
+	uint32_t size;
+	double weight; /* measured throughput, units per ns */
+	double ns;
+};
+
+static ze_image_handle_t createImage(ze_context_handle_t context, ze_device_handle_t device,
+				     Matrix &M)
+{
+	ze_image_format_t img_fmt = { ZE_IMAGE_FORMAT_LAYOUT_32, ZE_IMAGE_FORMAT_TYPE_FLOAT };
+	ze_image_desc_t desc = { ZE_STRUCTURE_TYPE_IMAGE_DESC,
+				 nullptr,
+				 ZE_IMAGE_FLAG_KERNEL_WRITE,
+				 ZE_IMAGE_TYPE_2D,
+				 img_fmt,
+				 M.ld(),
+				 M.rows(),
+				 0,
+				 0,
+				 0 };
+	ze_image_handle_t hImage;
+	CHECK(zeImageCreate(context, device, &desc, &hImage));
+	return hImage;
+}
+
+// next split in proportion to the throughput every part had in this run
+static void rebalance(vector<Part> &parts, uint32_t total, uint32_t align)
+{
+	vector<double> weights;
+	for (auto &p : parts) {
+		if (p.size > 0 && p.ns > 0.0)
+			p.weight = p.size / p.ns;
+		weights.push_back(p.weight);
+	}
+	vector<uint32_t> sizes = zePartition(total, weights, align);
+	uint32_t start = 0;
+	for (size_t i = 0; i < parts.size(); i++) {
+		parts[i].start = start;
+		parts[i].size = sizes[i];
+		start += sizes[i];
+	}
+}
+
+// work / ns is GFLOPS for flops and GB/s for bytes
+static void printSplit(const char *name, vector<Part> &parts, double wall_ns, double work,
+		       const char *unit)
+{
+	printf("%s: %.3f us, %.2f %s, split", name, wall_ns / 1000.0, work / wall_ns, unit);
+	for (auto &p : parts)
+		printf(" %u (%.1f us)", p.size, p.ns / 1000.0);
+	printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+	// usage: main.l0.skl [m n k [iterations [elements]]]
+	uint32_t m = 256, n = 256, k = 256;
+	int nIterations = 4;
+	uint32_t nElements = 1 << 20;
+
+	if (argc > 3) {
+		m = atoi(argv[1]);
+		n = atoi(argv[2]);
+		k = atoi(argv[3]);
+	}
+	if (argc > 4)
+		nIterations = atoi(argv[4]);
+	if (argc > 5)
+		nElements = ALIGN((uint32_t)atoi(argv[5]), CHUNK);
+
+	Matrix A_in(m, k, true);
+	Matrix B_in(k, n, true);
+	Matrix C_in(m, n, true);
+	Matrix C_out(C_in);
+	Matrix C_test(C_in);
+
+	cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, 1.0f, A_in.data(),
+		    A_in.ld(), B_in.data(), B_in.ld(), 1.0f, C_test.data(), C_test.ld());
+
+	vector<int> src1(nElements), src2(nElements), dst(nElements, 0);
+	for (uint32_t i = 0; i < nElements; i++) {
+		src1[i] = i;
+		src2[i] = i << 2;
+	}
+
+	// initialize GPU
+	ze_driver_handle_t driver = nullptr;
+	ze_context_handle_t context = nullptr;
+	vector<ze_device_handle_t> devices;
+
+	CHECK(zeInit(ZE_INIT_FLAG_GPU_ONLY));
+
+	// Discover all the driver instances
+	uint32_t driverCount = 0;
+	CHECK(zeDriverGet(&driverCount, nullptr));
+	CHECK2((driverCount == 0), "unable to locate driver(s)");
+
+	vector<ze_driver_handle_t> allDrivers(driverCount);
+	CHECK(zeDriverGet(&driverCount, allDrivers.data()));
+
+	// the first driver with a GPU, all of its GPUs and tiles are used
+	for (uint32_t i = 0; i < driverCount; ++i) {
+		devices = zeLeafDevices(allDrivers[i]);
+		if (!devices.empty()) {
+			driver = allDrivers[i];
+			break;
+		}
+	}
+	CHECK2((driver == nullptr), "unable to locate driver with GPU device");
+	fprintf(stderr, "INFO: %zu devices\n", devices.size());
+
+	ze_context_desc_t contextDesc = { ZE_STRUCTURE_TYPE_CONTEXT_DESC, nullptr, 0 };
+	CHECK(zeContextCreate(driver, &contextDesc, &context));
+
+	vector<unsigned char> code = readKernel(KERNEL);
+
+	vector<Part> parts(devices.size());
+	size_t bytes = nElements * sizeof(int);
+	for (size_t i = 0; i < devices.size(); i++) {
+		Part &p = parts[i];
+		p.device = devices[i];
+		CHECK(zeDeviceGetProperties(p.device, &p.props));
+		printf("device %zu: %s\n", i, p.props.name);
+
+		/* every part gets its own queue even when ZE_FAKE_DEVICES repeats a device */
+		ze_command_queue_desc_t commandQueueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
+							     nullptr,
+							     0,
+							     0,
+							     0,
+							     ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+							     ZE_COMMAND_QUEUE_PRIORITY_NORMAL };
+		CHECK(zeCommandListCreateImmediate(context, p.device, &commandQueueDesc,
+						   &p.commands));
+
+		ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
+						   ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP, 1 };
+		CHECK(zeEventPoolCreate(context, &pool_desc, 1, &p.device, &p.pool));
+		ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, 0, 0, 0 };
+		CHECK(zeEventCreate(p.pool, &desc, &p.event));
+
+		ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
+						nullptr,
+						ZE_MODULE_FORMAT_IL_SPIRV,
+						code.size(),
+						code.data(),
+						"-vc-codegen",
+						nullptr };
+		CHECK(zeModuleCreate(context, p.device, &moduleDesc, &p.module, nullptr));
+		ze_kernel_desc_t gemmDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0,
+					      "sgemm_kernel_part" };
+		CHECK(zeKernelCreate(p.module, &gemmDesc, &p.gemm));
+		ze_kernel_desc_t addDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0,
+					     "vector_add_part" };
+		CHECK(zeKernelCreate(p.module, &addDesc, &p.add));
+		CHECK(zeKernelSetGroupSize(p.gemm, 1, 1, 1));
+		CHECK(zeKernelSetGroupSize(p.add, 1, 1, 1));
+
+		/* full operands on every device, only the output block is gathered */
+		p.A = createImage(context, p.device, A_in);
+		p.B = createImage(context, p.device, B_in);
+		p.C = createImage(context, p.device, C_in);
+		CHECK(zeCommandListAppendImageCopyFromMemory(p.commands, p.A, A_in.data(), nullptr,
+							     nullptr, 0, nullptr));
+		CHECK(zeCommandListAppendImageCopyFromMemory(p.commands, p.B, B_in.data(), nullptr,
+							     nullptr, 0, nullptr));
+
+		ze_device_mem_alloc_desc_t deviceMemDesc = {
+			ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC, nullptr, 0, 0
+		};
+		CHECK(zeMemAllocDevice(context, &deviceMemDesc, bytes, 64, p.device, &p.a));
+		CHECK(zeMemAllocDevice(context, &deviceMemDesc, bytes, 64, p.device, &p.b));
+		CHECK(zeMemAllocDevice(context, &deviceMemDesc, bytes, 64, p.device, &p.c));
+		CHECK(zeCommandListAppendMemoryCopy(p.commands, p.a, src1.data(), bytes, nullptr,
+						    0, nullptr));
+		CHECK(zeCommandListAppendMemoryCopy(p.commands, p.b, src2.data(), bytes, nullptr,
+						    0, nullptr));
+		CHECK(zeCommandListAppendBarrier(p.commands, nullptr, 0, nullptr));
+
+		CHECK(zeKernelSetArgumentValue(p.gemm, 1, sizeof(n), &n));
+		CHECK(zeKernelSetArgumentValue(p.gemm, 2, sizeof(k), &k));
+		CHECK(zeKernelSetArgumentValue(p.gemm, 3, sizeof(p.A), &p.A));
+		CHECK(zeKernelSetArgumentValue(p.gemm, 4, sizeof(p.B), &p.B));
+		CHECK(zeKernelSetArgumentValue(p.gemm, 5, sizeof(p.C), &p.C));
+		CHECK(zeKernelSetArgumentValue(p.add, 1, sizeof(p.a), &p.a));
+		CHECK(zeKernelSetArgumentValue(p.add, 2, sizeof(p.b), &p.b));
+		CHECK(zeKernelSetArgumentValue(p.add, 3, sizeof(p.c), &p.c));
+		p.weight = 1.0;
+		p.ns = 0.0;
+	}
+
+	/*
+	 * GEMM, C is split in row blocks. The first run splits evenly, every
+	 * later one in proportion to the rows per ns each device reached.
+	 */
+	rebalance(parts, m, 1);
+	for (int iter = 0; iter < nIterations; iter++) {
+		auto t0 = chrono::steady_clock::now();
+		for (auto &p : parts) {
+			if (p.size == 0)
+				continue;
+			/* every iteration starts from the original C */
+			CHECK(zeCommandListAppendImageCopyFromMemory(p.commands, p.C, C_in.data(),
+								     nullptr, nullptr, 0, nullptr));
+			CHECK(zeCommandListAppendBarrier(p.commands, nullptr, 0, nullptr));
+
+			int row0 = p.start;
+			CHECK(zeKernelSetArgumentValue(p.gemm, 0, sizeof(row0), &row0));
+			ze_group_count_t groupCount = { n, p.size, 1 };
+			CHECK(zeCommandListAppendLaunchKernel(p.commands, p.gemm, &groupCount,
+							      p.event, 0, nullptr));
+		}
+		for (auto &p : parts) {
+			if (p.size == 0)
+				continue;
+			CHECK(zeEventHostSynchronize(p.event, UINT64_MAX));
+			p.ns = kernelTimeNs(p.event, p.props);
+			CHECK(zeEventHostReset(p.event));
+
+			/* gather: only this part's rows of C come back */
+			ze_image_region_t region = { 0, p.start, 0, C_out.ld(), p.size, 1 };
+			CHECK(zeCommandListAppendImageCopyToMemory(
+				p.commands, C_out.data() + (size_t)p.start * C_out.ld(), p.C,
+				&region, p.event, 0, nullptr));
+		}
+		for (auto &p : parts) {
+			if (p.size == 0)
+				continue;
+			CHECK(zeEventHostSynchronize(p.event, UINT64_MAX));
+			CHECK(zeEventHostReset(p.event));
+		}
+		chrono::duration<double, nano> wall = chrono::steady_clock::now() - t0;
+		printSplit("sgemm", parts, wall.count(), 2.0 * m * n * k, "GFLOPS");
+		rebalance(parts, m, 1);
+	}
+
+	/* either check failing fails the run */
+	bool ok = C_out == C_test;
+	if (ok)
+		printf("GPU partitioned sgemm test PASSED\n");
+	else
+		printf("GPU partitioned sgemm error\n");
+
+	/* elementwise, split in CHUNK element blocks the same way */
+	uint32_t chunks = nElements / CHUNK;
+	for (auto &p : parts) {
+		p.weight = 1.0;
+		p.ns = 0.0;
+	}
+	rebalance(parts, chunks, 1);
+	for (int iter = 0; iter < nIterations; iter++) {
+		auto t0 = chrono::steady_clock::now();
+		for (auto &p : parts) {
+			if (p.size == 0)
+				continue;
+			int chunk0 = p.start;
+			CHECK(zeKernelSetArgumentValue(p.add, 0, sizeof(chunk0), &chunk0));
+			ze_group_count_t groupCount = { p.size, 1, 1 };
+			CHECK(zeCommandListAppendLaunchKernel(p.commands, p.add, &groupCount,
+							      p.event, 0, nullptr));
+		}
+		for (auto &p : parts) {
+			if (p.size == 0)
+				continue;
+			CHECK(zeEventHostSynchronize(p.event, UINT64_MAX));
+			p.ns = kernelTimeNs(p.event, p.props);
+			CHECK(zeEventHostReset(p.event));
+
+			size_t offset = (size_t)p.start * CHUNK;
+			CHECK(zeCommandListAppendMemoryCopy(p.commands, dst.data() + offset,
+							    (int *)p.c + offset,
+							    (size_t)p.size * CHUNK * sizeof(int),
+							    p.event, 0, nullptr));
+		}
+		for (auto &p : parts) {
+			if (p.size == 0)
+				continue;
+			CHECK(zeEventHostSynchronize(p.event, UINT64_MAX));
+			CHECK(zeEventHostReset(p.event));
+		}
+		chrono::duration<double, nano> wall = chrono::steady_clock::now() - t0;
+		printSplit("vector_add", parts, wall.count(), 3.0 * bytes, "GB/s");
+		rebalance(parts, chunks, 1);
+	}
+
+	bool added = true;
+	for (uint32_t i = 0; i < nElements && added; i++)
+		if (src1[i] + src2[i] != dst[i]) {
+			fprintf(stderr, "FAIL: comparison at index[%u]: %d(host), but %d(gpu)\n", i,
+				src1[i] + src2[i], dst[i]);
+			added = false;
+		}
+	if (added)
+		printf("GPU partitioned vector_add test PASSED\n");
+	ok = ok && added;
+
+	for (auto &p : parts) {
+		zeMemFree(context, p.a);
+		zeMemFree(context, p.b);
+		zeMemFree(context, p.c);
+		zeImageDestroy(p.A);
+		zeImageDestroy(p.B);
+		zeImageDestroy(p.C);
+		zeKernelDestroy(p.gemm);
+		zeKernelDestroy(p.add);
+		zeModuleDestroy(p.module);
+		zeEventDestroy(p.event);
+		zeEventPoolDestroy(p.pool);
+		zeCommandListDestroy(p.commands);
+	}
+	zeContextDestroy(context);
+
+	printf("done\n");
+	return ok ? 0 : -1;
+}
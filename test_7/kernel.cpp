@@ -0,0 +1,68 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <cm/cm.h>
+
+#define SZ 16
+
+// C := A*B + C on the rows [row0, row0 + rows) of C
+// A(m x k) , B(k x n) , C(m x n) are full size on every device, the host
+// launches c_cols x rows threads and every thread calulate one element of C
+// the same way as test_3 sgemm_kernel_am
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+sgemm_kernel_part(int row0, int n, int k,
+		  SurfaceIndex indxA [[type("image2d_t float")]],
+		  SurfaceIndex indxB [[type("image2d_t float")]],
+		  SurfaceIndex indxC [[type("image2d_t float")]])
+{
+	uint32_t dst_col = (cm_group_id(0) * cm_local_size(0) + cm_local_id(0)) * sizeof(float);
+	uint32_t dst_row = row0 + cm_group_id(1) * cm_local_size(1) + cm_local_id(1);
+	vector<float, SZ> res = 0.0f;
+
+	for (int kk = 0; kk < k; kk += SZ) {
+		vector<float, SZ> a;
+		matrix<float, SZ, 1> b;
+
+		read(indxA, kk * sizeof(float), dst_row, a.select<8, 1>(0));
+		read(indxA, (kk + 8) * sizeof(float), dst_row, a.select<8, 1>(8));
+		read(indxB, dst_col, kk, b.select<8, 1, 1, 1>(0, 0));
+		read(indxB, dst_col, kk + 8, b.select<8, 1, 1, 1>(8, 0));
+
+		a = b * a;
+		res += a;
+	}
+	vector<float, 1> c_old;
+	read(indxC, dst_col, dst_row, c_old);
+	vector<float, 1> c = c_old(0) + cm_sum<float>(res);
+	write(indxC, dst_col, dst_row, c);
+}
+
+// c := a + b on the 16 element chunks [chunk0, chunk0 + chunks), one chunk
+// per thread
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+vector_add_part(int chunk0,
+		SurfaceIndex isurface1 [[type("buffer_t")]],
+		SurfaceIndex isurface2 [[type("buffer_t")]],
+		SurfaceIndex osurface [[type("buffer_t")]])
+{
+	vector<int, SZ> ivector1;
+	vector<int, SZ> ivector2;
+	unsigned offset = sizeof(int) * SZ * (chunk0 + cm_linear_global_id());
+
+	read(isurface1, offset, ivector1);
+	read(isurface2, offset, ivector2);
+	write(osurface, offset, ivector1 + ivector2);
+}
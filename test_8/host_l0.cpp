@@ -0,0 +1,422 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+#include <thread>
+#include <vector>
+
+#include <level_zero/ze_api.h>
+
+#include "ze_devices.h"
+
+#include <gsl/gsl_cblas.h>
+#include <algorithm>
+
+using namespace std;
+
+#define CHECK(a)                                                              \
+	do {                                                                  \
+		auto err = (a);                                               \
+		if (err != 0) {                                               \
+			fprintf(stderr, "FAIL: err=%d @ line=%d (%s)\n", err, \
+				__LINE__, (#a));                              \
+			exit(err);                                            \
+		}                                                             \
+	} while (0)
+#define CHECK2(a, msg)                                                      \
+	do {                                                                \
+		if ((a)) {                                                  \
+			fprintf(stderr, "FAIL: @ line=%d (%s)\n", __LINE__, \
+				(msg));                                     \
+			exit(-1);                                           \
+		}                                                           \
+	} while (0)
+#ifndef KERNEL
+#error "Error: KERNEL must be defined with location of kernel binary"
+#endif
+
+#define KERNEL_ALIGN 16LLU
+/* @a is a power of 2 value */
+#define __ALIGN_KERNEL_MASK(x, mask) (((x) + (mask)) & ~(mask))
+#define __ALIGN_KERNEL(x, a) __ALIGN_KERNEL_MASK(x, (typeof(x))(a)-1)
+#define ALIGN(x, a) __ALIGN_KERNEL((x), (a))
+
+/* columns of C per sgemm_rows thread */
+#define TILE_N 16
+
+static float randData(float low, float high)
+{
+	float t = (float)rand() / (float)RAND_MAX;
+	return (1.0f - t) * low + t * high;
+}
+
+class Matrix {
+	float *M;
+	uint32_t nrows;
+	uint32_t nrows_aligned;
+	uint32_t ncols;
+	uint32_t ncols_aligned;
+
+    public:
+	float &operator()(int r, int c)
+	{
+		return M[r * ncols_aligned + c];
+	}
+
+	Matrix(uint32_t rows, uint32_t cols, bool init)
+	{
+		this->nrows = rows;
+		this->nrows_aligned = ALIGN(this->nrows, KERNEL_ALIGN);
+		this->ncols = cols;
+		this->ncols_aligned = ALIGN(this->ncols, KERNEL_ALIGN);
+
+		size_t size = sizeof(float) * this->nrows_aligned * this->ncols_aligned;
+
+		M = (float *)aligned_alloc(4096, size);
+		/* kernels walk k in steps of 16, padding must not add to the sum */
+		memset(M, 0, size);
+
+		if (init)
+			for (int i = 0; i < rows; i++)
+				for (int j = 0; j < cols; j++)
+					(*this)(i, j) = randData(0.0f, 1.0f);
+	}
+
+	Matrix(Matrix &m)
+		: nrows(m.nrows)
+		, nrows_aligned(m.nrows_aligned)
+		, ncols(m.ncols)
+		, ncols_aligned(m.ncols_aligned)
+	{
+		size_t size = sizeof(float) * this->nrows_aligned * this->ncols_aligned;
+
+		M = (float *)aligned_alloc(4096, size);
+		memcpy(M, m.M, size);
+	}
+
+#define CORRECTNESS_THRESHOLD 0.00002
+	bool operator==(Matrix &m)
+	{
+		double max_relerror = 0.0;
+		for (int r = 0; r < nrows; r++)
+			for (int c = 0; c < ncols; c++) {
+				double relerror = fabs((*this)(r, c) - m(r, c)) /
+						  max(fabs((*this)(r, c)), fabs(m(r, c)));
+				max_relerror = max(max_relerror, relerror);
+				if (relerror > CORRECTNESS_THRESHOLD) {
+					printf("Failure %f %f relerror: %lf at [%d, %d]\n",
+					       (*this)(r, c), m(r, c), relerror, r, c);
+					return false;
+				}
+			}
+		printf("max_relerror = %e\n", max_relerror);
+		return true;
+	}
+
+	uint32_t rows()
+	{
+		return nrows;
+	};
+	uint32_t cols()
+	{
+		return ncols;
+	};
+	uint32_t ld()
+	{
+		return ncols_aligned;
+	}
+	float *data()
+	{
+		return M;
+	}
+
+	~Matrix()
+	{
+		free(M);
+	}
+};
+
+static double kernelTimeNs(ze_event_handle_t hEvent, ze_device_properties_t &props)
+{
+	ze_kernel_timestamp_result_t ts;
+	CHECK(zeEventQueryKernelTimestamp(hEvent, &ts));
+
+	uint64_t mask = props.kernelTimestampValidBits >= 64 ?
+				~0ULL :
+				(1ULL << props.kernelTimestampValidBits) - 1;
+	uint64_t cycles = (ts.context.kernelEnd - ts.context.kernelStart) & mask;
+	/* timerResolution is in ns per cycle */
+	return cycles * (double)props.timerResolution;
+}
+
+static vector<unsigned char> readKernel(const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+	if (fp == nullptr) {
+		fprintf(stderr, "FAIL: unable to open %s\n", path);
+		exit(-1);
+	}
+	fseek(fp, 0, SEEK_END);
+	vector<unsigned char> code(ftell(fp));
+	rewind(fp);
+	size_t ret = fread(code.data(), 1, code.size(), fp);
+	fclose(fp);
+	CHECK2(ret != code.size(), "Error reading kernel");
+	return code;
+}
+
+static ze_image_handle_t createImage(ze_context_handle_t context, ze_device_handle_t device,
+				     Matrix &M)
+{
+	ze_image_format_t img_fmt = { ZE_IMAGE_FORMAT_LAYOUT_32, ZE_IMAGE_FORMAT_TYPE_FLOAT };
+	ze_image_desc_t desc = { ZE_STRUCTURE_TYPE_IMAGE_DESC,
+				 nullptr,
+				 ZE_IMAGE_FLAG_KERNEL_WRITE,
+				 ZE_IMAGE_TYPE_2D,
+				 img_fmt,
+				 M.ld(),
+				 M.rows(),
+				 0,
+				 0,
+				 0 };
+	ze_image_handle_t hImage;
+	CHECK(zeImageCreate(context, device, &desc, &hImage));
+	return hImage;
+}
+
+// C rows [row0, row0 + rows) := A*B + C on the CPU, split across threads
+// that each run cblas_sgemm on a contiguous row block
+static void cpuRows(int nthreads, uint32_t row0, uint32_t rows, uint32_t n, uint32_t k,
+		    Matrix &A, Matrix &B, float *C, uint32_t ldc)
+{
+	vector<thread> workers;
+	vector<double> weights(nthreads, 1.0);
+	vector<uint32_t> sizes = zePartition(rows, weights);
+	uint32_t start = row0;
+	for (int t = 0; t < nthreads; t++) {
+		uint32_t r = start, cnt = sizes[t];
+		start += cnt;
+		if (cnt == 0)
+			continue;
+		workers.emplace_back([=, &A, &B]() {
+			cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, cnt, n, k, 1.0f,
+				    A.data() + (size_t)r * A.ld(), A.ld(), B.data(), B.ld(), 1.0f,
+				    C + (size_t)r * ldc, ldc);
+		});
+	}
+	for (auto &w : workers)
+		w.join();
+}
+
+int main(int argc, char *argv[])
+{
+	// usage: main.l0.skl [m n k [iterations [cpu threads]]]
+	uint32_t m = 1024, n = 1024, k = 1024;
+	int nIterations = 8;
+	int nThreads = max(1, (int)thread::hardware_concurrency() - 1);
+
+	if (argc > 3) {
+		m = atoi(argv[1]);
+		n = atoi(argv[2]);
+		k = atoi(argv[3]);
+	}
+	if (argc > 4)
+		nIterations = atoi(argv[4]);
+	if (argc > 5)
+		nThreads = atoi(argv[5]);
+
+	Matrix A_in(m, k, true);
+	Matrix B_in(k, n, true);
+	Matrix C_in(m, n, true);
+	Matrix C_test(C_in);
+
+	cblas_sgemm(CblasRowMajor, CblasNoTrans, CblasNoTrans, m, n, k, 1.0f, A_in.data(),
+		    A_in.ld(), B_in.data(), B_in.ld(), 1.0f, C_test.data(), C_test.ld());
+
+	// initialize GPU
+	ze_driver_handle_t driver = nullptr;
+	ze_device_handle_t device = nullptr;
+	ze_context_handle_t context = nullptr;
+	ze_command_list_handle_t commands;
+	ze_module_handle_t module;
+	ze_kernel_handle_t kernel;
+
+	CHECK(zeInit(ZE_INIT_FLAG_GPU_ONLY));
+
+	// Discover all the driver instances
+	uint32_t driverCount = 0;
+	CHECK(zeDriverGet(&driverCount, nullptr));
+	CHECK2((driverCount == 0), "unable to locate driver(s)");
+
+	vector<ze_driver_handle_t> allDrivers(driverCount);
+	CHECK(zeDriverGet(&driverCount, allDrivers.data()));
+
+	// Find a driver instance with a GPU device
+	for (uint32_t i = 0; i < driverCount; ++i) {
+		vector<ze_device_handle_t> devices = zeLeafDevices(allDrivers[i]);
+		if (!devices.empty()) {
+			driver = allDrivers[i];
+			device = devices[0];
+			break;
+		}
+	}
+	CHECK2((driver == nullptr), "unable to locate driver with GPU device");
+	CHECK2((device == nullptr), "unable to locate GPU device");
+
+	ze_device_properties_t device_properties;
+	CHECK(zeDeviceGetProperties(device, &device_properties));
+
+	ze_context_desc_t contextDesc = { ZE_STRUCTURE_TYPE_CONTEXT_DESC, nullptr, 0 };
+	CHECK(zeContextCreate(driver, &contextDesc, &context));
+
+	ze_command_queue_desc_t commandQueueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
+						     nullptr,
+						     0,
+						     0,
+						     0,
+						     ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+						     ZE_COMMAND_QUEUE_PRIORITY_NORMAL };
+	CHECK(zeCommandListCreateImmediate(context, device, &commandQueueDesc, &commands));
+
+	ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
+					   ZE_EVENT_POOL_FLAG_KERNEL_TIMESTAMP, 1 };
+	ze_event_pool_handle_t hPool = nullptr;
+	CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &hPool));
+	ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, 0, 0, 0 };
+	ze_event_handle_t hEvent = nullptr;
+	CHECK(zeEventCreate(hPool, &desc, &hEvent));
+
+	/*
+	 * C is one USM allocation that the GPU and the CPU threads write at
+	 * the same time, each to its own rows. That needs concurrent access,
+	 * shared memory has it on integrated GPUs, host memory is the fallback.
+	 */
+	ze_device_memory_access_properties_t access = {
+		ZE_STRUCTURE_TYPE_DEVICE_MEMORY_ACCESS_PROPERTIES
+	};
+	CHECK(zeDeviceGetMemoryAccessProperties(device, &access));
+	size_t c_bytes = sizeof(float) * (size_t)C_in.rows() * C_in.ld();
+	float *C = nullptr;
+	ze_host_mem_alloc_desc_t hostDesc = { ZE_STRUCTURE_TYPE_HOST_MEM_ALLOC_DESC, nullptr, 0 };
+	if (access.sharedSingleDeviceAllocCapabilities & ZE_MEMORY_ACCESS_CAP_FLAG_CONCURRENT) {
+		ze_device_mem_alloc_desc_t deviceDesc = { ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC,
+							  nullptr, 0, 0 };
+		CHECK(zeMemAllocShared(context, &deviceDesc, &hostDesc, c_bytes, 64, device,
+				       (void **)&C));
+		printf("C in shared USM\n");
+	} else {
+		CHECK(zeMemAllocHost(context, &hostDesc, c_bytes, 64, (void **)&C));
+		printf("C in host USM, shared USM has no concurrent access\n");
+	}
+
+	ze_image_handle_t hAImage = createImage(context, device, A_in);
+	ze_image_handle_t hBImage = createImage(context, device, B_in);
+	CHECK(zeCommandListAppendImageCopyFromMemory(commands, hAImage, A_in.data(), nullptr,
+						     hEvent, 0, nullptr));
+	CHECK(zeEventHostSynchronize(hEvent, UINT64_MAX));
+	CHECK(zeEventHostReset(hEvent));
+	CHECK(zeCommandListAppendImageCopyFromMemory(commands, hBImage, B_in.data(), nullptr,
+						     hEvent, 0, nullptr));
+	CHECK(zeEventHostSynchronize(hEvent, UINT64_MAX));
+	CHECK(zeEventHostReset(hEvent));
+
+	vector<unsigned char> code = readKernel(KERNEL);
+	ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
+					nullptr,
+					ZE_MODULE_FORMAT_IL_SPIRV,
+					code.size(),
+					code.data(),
+					"-vc-codegen",
+					nullptr };
+	CHECK(zeModuleCreate(context, device, &moduleDesc, &module, nullptr));
+	ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0, "sgemm_rows" };
+	CHECK(zeKernelCreate(module, &kernelDesc, &kernel));
+	CHECK(zeKernelSetGroupSize(kernel, 1, 1, 1));
+
+	uint32_t ldc = C_in.ld();
+	CHECK(zeKernelSetArgumentValue(kernel, 1, sizeof(k), &k));
+	CHECK(zeKernelSetArgumentValue(kernel, 2, sizeof(ldc), &ldc));
+	CHECK(zeKernelSetArgumentValue(kernel, 3, sizeof(hAImage), &hAImage));
+	CHECK(zeKernelSetArgumentValue(kernel, 4, sizeof(hBImage), &hBImage));
+	CHECK(zeKernelSetArgumentValue(kernel, 5, sizeof(C), &C));
+
+	/*
+	 * The GPU gets the first gpu_rows rows, the CPU the rest. The first
+	 * run splits evenly, every later one in proportion to the rows per ns
+	 * each side reached in the previous run.
+	 */
+	vector<double> rates = { 1.0, 1.0 };
+	double flops = 2.0 * m * n * k;
+	bool ok = true;
+	for (int iter = 0; iter < nIterations; iter++) {
+		vector<uint32_t> split = zePartition(m, rates);
+		uint32_t gpu_rows = split[0], cpu_rows = split[1];
+
+		/* every iteration starts from the original C */
+		memcpy(C, C_in.data(), c_bytes);
+
+		auto t0 = chrono::steady_clock::now();
+		if (gpu_rows > 0) {
+			int row0 = 0;
+			CHECK(zeKernelSetArgumentValue(kernel, 0, sizeof(row0), &row0));
+			ze_group_count_t groupCount = { ldc / TILE_N, gpu_rows, 1 };
+			CHECK(zeCommandListAppendLaunchKernel(commands, kernel, &groupCount, hEvent,
+							      0, nullptr));
+		}
+		cpuRows(nThreads, gpu_rows, cpu_rows, n, k, A_in, B_in, C, ldc);
+		auto t1 = chrono::steady_clock::now();
+
+		double gpu_ns = 0.0;
+		if (gpu_rows > 0) {
+			CHECK(zeEventHostSynchronize(hEvent, UINT64_MAX));
+			gpu_ns = kernelTimeNs(hEvent, device_properties);
+			CHECK(zeEventHostReset(hEvent));
+		}
+		auto t2 = chrono::steady_clock::now();
+
+		double cpu_ns = chrono::duration<double, nano>(t1 - t0).count();
+		double wall_ns = chrono::duration<double, nano>(t2 - t0).count();
+		printf("split gpu %u / cpu %u rows: gpu %.3f us, cpu %.3f us, total %.3f us, %.2f GFLOPS\n",
+		       gpu_rows, cpu_rows, gpu_ns / 1000.0, cpu_ns / 1000.0, wall_ns / 1000.0,
+		       flops / wall_ns);
+
+		if (gpu_rows > 0 && gpu_ns > 0.0)
+			rates[0] = gpu_rows / gpu_ns;
+		if (cpu_rows > 0 && cpu_ns > 0.0)
+			rates[1] = cpu_rows / cpu_ns;
+
+		Matrix C_out(m, n, false);
+		for (uint32_t r = 0; r < m; r++)
+			memcpy(&C_out(r, 0), C + (size_t)r * ldc, n * sizeof(float));
+		if (!(C_out == C_test)) {
+			printf("co-executed sgemm error\n");
+			ok = false;
+			break;
+		}
+	}
+	if (ok)
+		printf("co-executed sgemm test PASSED\n");
+
+	zeImageDestroy(hAImage);
+	zeImageDestroy(hBImage);
+	zeMemFree(context, C);
+	zeKernelDestroy(kernel);
+	zeModuleDestroy(module);
+	zeEventDestroy(hEvent);
+	zeEventPoolDestroy(hPool);
+	zeCommandListDestroy(commands);
+	zeContextDestroy(context);
+
+	printf("done\n");
+	return ok ? 0 : -1;
+}
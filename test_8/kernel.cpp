@@ -0,0 +1,51 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <cm/cm.h>
+
+#define TILE_N 16
+
+// C := A*B + C on the rows [row0, row0 + rows) of C
+// A(m x k) , B(k x n) are images, C is a USM buffer with leading dimension
+// ldc (a multiple of TILE_N) that the CPU writes at the same time, so the
+// kernel must not touch rows outside its block. A thread calulate a
+// 1 x TILE_N strip of C, B is streamed in 4 x TILE_N blocks and every
+// chunk of the A row is kept in registers.
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+sgemm_rows(int row0, int k, int ldc,
+	   SurfaceIndex indxA [[type("image2d_t float")]],
+	   SurfaceIndex indxB [[type("image2d_t float")]],
+	   SurfaceIndex indxC [[type("buffer_t")]])
+{
+	uint32_t col = (cm_group_id(0) * cm_local_size(0) + cm_local_id(0)) * TILE_N;
+	uint32_t row = row0 + cm_group_id(1) * cm_local_size(1) + cm_local_id(1);
+	vector<float, TILE_N> acc = 0.0f;
+
+	for (int kk = 0; kk < k; kk += 8) {
+		vector<float, 8> a;
+		matrix<float, 8, TILE_N> b;
+
+		read(indxA, kk * sizeof(float), row, a);
+		read(indxB, col * sizeof(float), kk, b.select<4, 1, TILE_N, 1>(0, 0));
+		read(indxB, col * sizeof(float), kk + 4, b.select<4, 1, TILE_N, 1>(4, 0));
+
+#pragma unroll
+		for (int t = 0; t < 8; t++)
+			acc += a(t) * b.row(t);
+	}
+
+	uint32_t offset = (row * ldc + col) * sizeof(float);
+	vector<float, TILE_N> c;
+	read(indxC, offset, c);
+	c += acc;
+	write(indxC, offset, c);
+}
@@ -0,0 +1,478 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <level_zero/ze_api.h>
+
+#include <algorithm>
+
+using namespace std;
+
+#define CHECK(a)                                                              \
+	do {                                                                  \
+		auto err = (a);                                               \
+		if (err != 0) {                                               \
+			fprintf(stderr, "FAIL: err=%d @ line=%d (%s)\n", err, \
+				__LINE__, (#a));                              \
+			exit(err);                                            \
+		}                                                             \
+	} while (0)
+#define CHECK2(a, msg)                                                      \
+	do {                                                                \
+		if ((a)) {                                                  \
+			fprintf(stderr, "FAIL: @ line=%d (%s)\n", __LINE__, \
+				(msg));                                     \
+			exit(-1);                                           \
+		}                                                           \
+	} while (0)
+#ifndef KERNEL
+#error "Error: KERNEL must be defined with location of kernel binary"
+#endif
+
+/* @a is a power of 2 value */
+#define __ALIGN_KERNEL_MASK(x, mask) (((x) + (mask)) & ~(mask))
+#define __ALIGN_KERNEL(x, a) __ALIGN_KERNEL_MASK(x, (typeof(x))(a)-1)
+#define ALIGN(x, a) __ALIGN_KERNEL((x), (a))
+
+/* columns of C per sgemm_panel thread */
+#define TILE_N 16
+/* A/B panel pairs in flight, C tiles in flight */
+#define PANEL_SLOTS 3
+#define TILE_SLOTS 2
+/* C entries checked against a CPU dot product */
+#define SAMPLES 64
+
+static float randData(float low, float high)
+{
+	float t = (float)rand() / (float)RAND_MAX;
+	return (1.0f - t) * low + t * high;
+}
+
+// row major rows x cols float matrix without padding, in host memory or
+// memory mapped from a raw file
+class HostMatrix {
+	float *M;
+	uint64_t nrows;
+	uint64_t ncols;
+	size_t mapped;
+
+    public:
+	HostMatrix(uint64_t rows, uint64_t cols) : nrows(rows), ncols(cols), mapped(0)
+	{
+		M = (float *)aligned_alloc(4096, ALIGN(bytes(), 4096));
+		CHECK2(M == nullptr, "out of host memory");
+		for (uint64_t i = 0; i < rows * cols; i++)
+			M[i] = randData(0.0f, 1.0f);
+	}
+
+	// maps path, a file of another size is recreated with random data
+	HostMatrix(const string &path, uint64_t rows, uint64_t cols)
+		: nrows(rows), ncols(cols), mapped(bytes())
+	{
+		int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+		CHECK2(fd < 0, path.c_str());
+
+		struct stat st;
+		CHECK(fstat(fd, &st));
+		bool fresh = (size_t)st.st_size != mapped;
+		if (fresh)
+			CHECK(ftruncate(fd, mapped));
+
+		M = (float *)mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		CHECK2(M == MAP_FAILED, "mmap failed");
+		close(fd);
+
+		if (fresh) {
+			printf("initializing %s\n", path.c_str());
+			for (uint64_t i = 0; i < rows * cols; i++)
+				M[i] = randData(0.0f, 1.0f);
+		}
+		/* panels are read front to back */
+		madvise(M, mapped, MADV_SEQUENTIAL);
+	}
+
+	~HostMatrix()
+	{
+		if (mapped)
+			munmap(M, mapped);
+		else
+			free(M);
+	}
+
+	float *at(uint64_t r, uint64_t c)
+	{
+		return M + r * ncols + c;
+	}
+	uint64_t cols()
+	{
+		return ncols;
+	}
+	size_t bytes()
+	{
+		return nrows * ncols * sizeof(float);
+	}
+};
+
+// copy engine ordinal if the device has one, compute otherwise
+static uint32_t queueOrdinal(ze_device_handle_t device, bool copy)
+{
+	uint32_t count = 0;
+	CHECK(zeDeviceGetCommandQueueGroupProperties(device, &count, nullptr));
+	vector<ze_command_queue_group_properties_t> groups(count);
+	for (auto &g : groups)
+		g = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_GROUP_PROPERTIES };
+	CHECK(zeDeviceGetCommandQueueGroupProperties(device, &count, groups.data()));
+
+	uint32_t compute = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		bool has_compute = groups[i].flags & ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COMPUTE;
+		bool has_copy = groups[i].flags & ZE_COMMAND_QUEUE_GROUP_PROPERTY_FLAG_COPY;
+		if (copy && has_copy && !has_compute)
+			return i;
+		if (has_compute)
+			compute = i;
+	}
+	return compute;
+}
+
+// host rows x width_bytes block at src (pitch src_pitch) -> dst (pitch dst_pitch)
+static void copy2d(ze_command_list_handle_t list, void *dst, size_t dst_pitch, const void *src,
+		   size_t src_pitch, size_t width_bytes, uint32_t rows, ze_event_handle_t signal,
+		   uint32_t nwait, ze_event_handle_t *wait)
+{
+	ze_copy_region_t dst_region = { 0, 0, 0, (uint32_t)width_bytes, rows, 1 };
+	ze_copy_region_t src_region = { 0, 0, 0, (uint32_t)width_bytes, rows, 1 };
+	CHECK(zeCommandListAppendMemoryCopyRegion(list, dst, &dst_region, dst_pitch, 0, src,
+						  &src_region, src_pitch, 0, signal, nwait, wait));
+}
+
+int main(int argc, char *argv[])
+{
+	// usage: main.l0.skl [m n k [tile_m tile_n tile_k [dir]]]
+	// with dir the matrices are the raw float files dir/{A,B,C}.bin,
+	// memory mapped, C is updated in place
+	uint64_t m = 4096, n = 4096, k = 4096;
+	uint32_t TM = 1024, TN = 1024, TK = 1024;
+	const char *dir = nullptr;
+
+	if (argc > 3) {
+		m = atoll(argv[1]);
+		n = atoll(argv[2]);
+		k = atoll(argv[3]);
+	}
+	if (argc > 6) {
+		TM = atoi(argv[4]);
+		TN = ALIGN((uint32_t)atoi(argv[5]), TILE_N);
+		TK = ALIGN((uint32_t)atoi(argv[6]), 8);
+	}
+	if (argc > 7)
+		dir = argv[7];
+
+	HostMatrix *A, *B, *C;
+	if (dir) {
+		A = new HostMatrix(string(dir) + "/A.bin", m, k);
+		B = new HostMatrix(string(dir) + "/B.bin", k, n);
+		C = new HostMatrix(string(dir) + "/C.bin", m, n);
+	} else {
+		A = new HostMatrix(m, k);
+		B = new HostMatrix(k, n);
+		C = new HostMatrix(m, n);
+	}
+
+	/* C is overwritten, keep the sampled entries' old values */
+	vector<uint64_t> sample_r(SAMPLES), sample_c(SAMPLES);
+	vector<double> expect(SAMPLES);
+	for (int s = 0; s < SAMPLES; s++) {
+		sample_r[s] = (uint64_t)rand() % m;
+		sample_c[s] = (uint64_t)rand() % n;
+		expect[s] = *C->at(sample_r[s], sample_c[s]);
+		for (uint64_t t = 0; t < k; t++)
+			expect[s] += (double)*A->at(sample_r[s], t) * *B->at(t, sample_c[s]);
+	}
+
+	// initialize GPU
+	ze_driver_handle_t driver = nullptr;
+	ze_device_handle_t device = nullptr;
+	ze_context_handle_t context = nullptr;
+	ze_command_list_handle_t copies, writebacks, compute;
+	ze_module_handle_t module;
+	ze_kernel_handle_t kernel;
+
+	CHECK(zeInit(ZE_INIT_FLAG_GPU_ONLY));
+
+	// Discover all the driver instances
+	uint32_t driverCount = 0;
+	CHECK(zeDriverGet(&driverCount, nullptr));
+	CHECK2((driverCount == 0), "unable to locate driver(s)");
+
+	ze_driver_handle_t *allDrivers =
+		(ze_driver_handle_t *)malloc(driverCount * sizeof(*allDrivers));
+	CHECK(zeDriverGet(&driverCount, allDrivers));
+
+	// Find a driver instance with a GPU device
+	for (uint32_t i = 0; i < driverCount; ++i) {
+		uint32_t deviceCount = 0;
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, nullptr));
+		if (deviceCount == 0)
+			continue;
+		ze_device_handle_t *allDevices = (ze_device_handle_t *)malloc(
+			deviceCount * sizeof(ze_device_handle_t));
+		CHECK(zeDeviceGet(allDrivers[i], &deviceCount, allDevices));
+		for (uint32_t d = 0; d < deviceCount; ++d) {
+			ze_device_properties_t device_properties;
+			CHECK(zeDeviceGetProperties(allDevices[d], &device_properties));
+			if (ZE_DEVICE_TYPE_GPU == device_properties.type) {
+				fprintf(stderr, "INFO: GPU device located driver=%d, device=%d\n",
+					i, d);
+				driver = allDrivers[i];
+				device = allDevices[d];
+				break;
+			}
+		}
+		if (nullptr != device)
+			break;
+	}
+	CHECK2((driver == nullptr), "unable to locate driver with GPU device");
+	CHECK2((device == nullptr), "unable to locate GPU device");
+
+	ze_context_desc_t contextDesc = { ZE_STRUCTURE_TYPE_CONTEXT_DESC, nullptr, 0 };
+	CHECK(zeContextCreate(driver, &contextDesc, &context));
+
+	/*
+	 * uploads and writebacks on the copy engine overlap the kernels; a
+	 * writeback waits for the kernels of its tile, on a list of its own it
+	 * does not hold up the uploads of the next tile behind it
+	 */
+	ze_command_queue_desc_t queueDesc = { ZE_STRUCTURE_TYPE_COMMAND_QUEUE_DESC,
+					      nullptr,
+					      queueOrdinal(device, true),
+					      0,
+					      0,
+					      ZE_COMMAND_QUEUE_MODE_ASYNCHRONOUS,
+					      ZE_COMMAND_QUEUE_PRIORITY_NORMAL };
+	CHECK(zeCommandListCreateImmediate(context, device, &queueDesc, &copies));
+	CHECK(zeCommandListCreateImmediate(context, device, &queueDesc, &writebacks));
+	queueDesc.ordinal = queueOrdinal(device, false);
+	CHECK(zeCommandListCreateImmediate(context, device, &queueDesc, &compute));
+
+	FILE *fp = fopen(KERNEL, "rb");
+	if (fp == nullptr) {
+		fprintf(stderr, "FAIL: unable to open %s\n", KERNEL);
+		exit(-1);
+	}
+	fseek(fp, 0, SEEK_END);
+	size_t sz = ftell(fp);
+	rewind(fp);
+	vector<unsigned char> code(sz);
+	CHECK2(fread(code.data(), 1, sz, fp) != sz, "Error reading kernel");
+	fclose(fp);
+
+	ze_module_desc_t moduleDesc = { ZE_STRUCTURE_TYPE_MODULE_DESC,
+					nullptr,
+					ZE_MODULE_FORMAT_IL_SPIRV,
+					sz,
+					code.data(),
+					"-vc-codegen",
+					nullptr };
+	CHECK(zeModuleCreate(context, device, &moduleDesc, &module, nullptr));
+	ze_kernel_desc_t kernelDesc = { ZE_STRUCTURE_TYPE_KERNEL_DESC, nullptr, 0, "sgemm_panel" };
+	CHECK(zeKernelCreate(module, &kernelDesc, &kernel));
+	CHECK(zeKernelSetGroupSize(kernel, 1, 1, 1));
+
+	/*
+	 * The only device memory: PANEL_SLOTS A/B panel pairs and TILE_SLOTS
+	 * C tiles. Device pitches are the tile sizes, TN is a multiple of
+	 * TILE_N and TK of 8.
+	 */
+	size_t a_bytes = (size_t)TM * TK * sizeof(float);
+	size_t b_bytes = (size_t)TK * TN * sizeof(float);
+	size_t c_bytes = (size_t)TM * TN * sizeof(float);
+	printf("%llux%llux%llu in %ux%ux%u tiles, %.1f MB of device memory\n",
+	       (unsigned long long)m, (unsigned long long)n, (unsigned long long)k, TM, TN, TK,
+	       (PANEL_SLOTS * (a_bytes + b_bytes) + TILE_SLOTS * c_bytes) / 1e6);
+
+	ze_device_mem_alloc_desc_t deviceMemDesc = { ZE_STRUCTURE_TYPE_DEVICE_MEM_ALLOC_DESC,
+						     nullptr, 0, 0 };
+	void *d_a[PANEL_SLOTS], *d_b[PANEL_SLOTS], *d_c[TILE_SLOTS];
+	for (int s = 0; s < PANEL_SLOTS; s++) {
+		CHECK(zeMemAllocDevice(context, &deviceMemDesc, a_bytes, 64, device, &d_a[s]));
+		CHECK(zeMemAllocDevice(context, &deviceMemDesc, b_bytes, 64, device, &d_b[s]));
+	}
+	for (int s = 0; s < TILE_SLOTS; s++)
+		CHECK(zeMemAllocDevice(context, &deviceMemDesc, c_bytes, 64, device, &d_c[s]));
+
+	/*
+	 * panel_up[s]: A/B panels are in slot s, waited for by the kernel
+	 * panel_done[s]: the kernel using slot s finished, the host waits for
+	 *	it before it uploads into the slot again
+	 * tile_up[t], tile_done[t], tile_wb[t]: C tile slot t uploaded, all of
+	 *	its k panels accumulated, written back
+	 * The host resets an event only after the event that follows it in
+	 * the chain has signaled, so no device wait can see a reset event.
+	 * The kernels of one tile are ordered by a barrier on the compute
+	 * list, not by panel_done: that one is reset as soon as its slot is
+	 * reused.
+	 */
+	enum { PANEL_UP, PANEL_DONE = PANEL_UP + PANEL_SLOTS, TILE_UP = PANEL_DONE + PANEL_SLOTS,
+	       TILE_DONE = TILE_UP + TILE_SLOTS, TILE_WB = TILE_DONE + TILE_SLOTS,
+	       NEVENTS = TILE_WB + TILE_SLOTS };
+	ze_event_pool_desc_t pool_desc = { ZE_STRUCTURE_TYPE_EVENT_POOL_DESC, nullptr,
+					   ZE_EVENT_POOL_FLAG_HOST_VISIBLE, NEVENTS };
+	ze_event_pool_handle_t hPool = nullptr;
+	CHECK(zeEventPoolCreate(context, &pool_desc, 1, &device, &hPool));
+	ze_event_handle_t ev[NEVENTS];
+	for (uint32_t i = 0; i < NEVENTS; i++) {
+		ze_event_desc_t desc = { ZE_STRUCTURE_TYPE_EVENT_DESC, nullptr, i,
+					 ZE_EVENT_SCOPE_FLAG_DEVICE, ZE_EVENT_SCOPE_FLAG_HOST };
+		CHECK(zeEventCreate(hPool, &desc, &ev[i]));
+	}
+	bool panel_busy[PANEL_SLOTS] = {}, tile_busy[TILE_SLOTS] = {};
+
+	uint64_t panels = 0, tiles = 0;
+	double streamed = 0.0;
+	auto t0 = chrono::steady_clock::now();
+	for (uint64_t i0 = 0; i0 < m; i0 += TM) {
+		for (uint64_t j0 = 0; j0 < n; j0 += TN) {
+			uint32_t tm = min<uint64_t>(TM, m - i0);
+			uint32_t tn = min<uint64_t>(TN, n - j0);
+			int t = tiles++ % TILE_SLOTS;
+
+			if (tile_busy[t]) {
+				CHECK(zeEventHostSynchronize(ev[TILE_WB + t], UINT64_MAX));
+				CHECK(zeEventHostReset(ev[TILE_WB + t]));
+				CHECK(zeEventHostReset(ev[TILE_DONE + t]));
+				CHECK(zeEventHostReset(ev[TILE_UP + t]));
+			}
+			tile_busy[t] = true;
+			copy2d(copies, d_c[t], TN * sizeof(float), C->at(i0, j0),
+			       C->cols() * sizeof(float), tn * sizeof(float), tm, ev[TILE_UP + t],
+			       0, nullptr);
+			streamed += 2.0 * tm * tn * sizeof(float);
+
+			for (uint64_t k0 = 0; k0 < k; k0 += TK) {
+				uint32_t tk = min<uint64_t>(TK, k - k0);
+				int s = panels++ % PANEL_SLOTS;
+
+				if (panel_busy[s]) {
+					CHECK(zeEventHostSynchronize(ev[PANEL_DONE + s],
+								     UINT64_MAX));
+					CHECK(zeEventHostReset(ev[PANEL_DONE + s]));
+					CHECK(zeEventHostReset(ev[PANEL_UP + s]));
+				}
+				panel_busy[s] = true;
+
+				/* the kernel walks k in steps of 8, the padding must be 0 */
+				if (tk % 8) {
+					float zero = 0.0f;
+					CHECK(zeCommandListAppendMemoryFill(copies, d_a[s], &zero,
+									    sizeof(zero), a_bytes,
+									    nullptr, 0, nullptr));
+					CHECK(zeCommandListAppendMemoryFill(copies, d_b[s], &zero,
+									    sizeof(zero), b_bytes,
+									    nullptr, 0, nullptr));
+					CHECK(zeCommandListAppendBarrier(copies, nullptr, 0,
+									 nullptr));
+				}
+				copy2d(copies, d_a[s], TK * sizeof(float), A->at(i0, k0),
+				       A->cols() * sizeof(float), tk * sizeof(float), tm, nullptr,
+				       0, nullptr);
+				copy2d(copies, d_b[s], TN * sizeof(float), B->at(k0, j0),
+				       B->cols() * sizeof(float), tn * sizeof(float), tk, nullptr,
+				       0, nullptr);
+				CHECK(zeCommandListAppendBarrier(copies, ev[PANEL_UP + s], 0,
+								 nullptr));
+				streamed += ((double)tm * tk + (double)tk * tn) * sizeof(float);
+
+				int tk_pad = ALIGN(tk, 8);
+				int lda = TK, ldb = TN, ldc = TN;
+				CHECK(zeKernelSetArgumentValue(kernel, 0, sizeof(tk_pad), &tk_pad));
+				CHECK(zeKernelSetArgumentValue(kernel, 1, sizeof(lda), &lda));
+				CHECK(zeKernelSetArgumentValue(kernel, 2, sizeof(ldb), &ldb));
+				CHECK(zeKernelSetArgumentValue(kernel, 3, sizeof(ldc), &ldc));
+				CHECK(zeKernelSetArgumentValue(kernel, 4, sizeof(d_a[s]), &d_a[s]));
+				CHECK(zeKernelSetArgumentValue(kernel, 5, sizeof(d_b[s]), &d_b[s]));
+				CHECK(zeKernelSetArgumentValue(kernel, 6, sizeof(d_c[t]), &d_c[t]));
+
+				/* the previous panel's kernel adds into the same C tile */
+				if (k0 > 0)
+					CHECK(zeCommandListAppendBarrier(compute, nullptr, 0,
+									 nullptr));
+
+				ze_event_handle_t wait[2] = { ev[PANEL_UP + s], ev[TILE_UP + t] };
+				ze_group_count_t groupCount = { ALIGN(tn, TILE_N) / TILE_N, tm, 1 };
+				CHECK(zeCommandListAppendLaunchKernel(compute, kernel, &groupCount,
+								      ev[PANEL_DONE + s],
+								      k0 == 0 ? 2 : 1, wait));
+			}
+
+			/* all k panels of the tile are in, write it back */
+			CHECK(zeCommandListAppendBarrier(compute, ev[TILE_DONE + t], 0, nullptr));
+			copy2d(writebacks, C->at(i0, j0), C->cols() * sizeof(float), d_c[t],
+			       TN * sizeof(float), tn * sizeof(float), tm, ev[TILE_WB + t], 1,
+			       &ev[TILE_DONE + t]);
+		}
+	}
+	for (int t = 0; t < TILE_SLOTS; t++)
+		if (tile_busy[t])
+			CHECK(zeEventHostSynchronize(ev[TILE_WB + t], UINT64_MAX));
+	double ns = chrono::duration<double, nano>(chrono::steady_clock::now() - t0).count();
+
+	printf("sgemm out of core: %.3f ms, %.2f GFLOPS, %.2f GB/s streamed, "
+	       "%llu tiles, %llu panels\n",
+	       ns / 1e6, 2.0 * m * n * k / ns, streamed / ns, (unsigned long long)tiles,
+	       (unsigned long long)panels);
+
+	bool ok = true;
+	for (int s = 0; s < SAMPLES; s++) {
+		double got = *C->at(sample_r[s], sample_c[s]);
+		double relerror = fabs(got - expect[s]) / max(fabs(got), fabs(expect[s]));
+		if (relerror > 1e-4) {
+			printf("Failure %f %f relerror: %lf at [%llu, %llu]\n", got, expect[s],
+			       relerror, (unsigned long long)sample_r[s],
+			       (unsigned long long)sample_c[s]);
+			ok = false;
+		}
+	}
+	printf(ok ? "GPU out of core sgemm test PASSED\n" : "GPU out of core sgemm error\n");
+
+	for (uint32_t i = 0; i < NEVENTS; i++)
+		zeEventDestroy(ev[i]);
+	zeEventPoolDestroy(hPool);
+	for (int s = 0; s < PANEL_SLOTS; s++) {
+		zeMemFree(context, d_a[s]);
+		zeMemFree(context, d_b[s]);
+	}
+	for (int s = 0; s < TILE_SLOTS; s++)
+		zeMemFree(context, d_c[s]);
+	zeKernelDestroy(kernel);
+	zeModuleDestroy(module);
+	zeCommandListDestroy(copies);
+	zeCommandListDestroy(writebacks);
+	zeCommandListDestroy(compute);
+	zeContextDestroy(context);
+
+	delete A;
+	delete B;
+	delete C;
+
+	printf("done\n");
+	return ok ? 0 : -1;
+}
@@ -0,0 +1,51 @@
+/*========================== begin_copyright_notice ============================
+
+Copyright (C) 2020-2021 Intel Corporation
+
+SPDX-License-Identifier: MIT
+
+============================= end_copyright_notice ===========================*/
+
+#include <cm/cm.h>
+
+#define TILE_N 16
+
+// C := A*B + C for one panel pair, all three are device buffers
+// A(tm x tk) with pitch lda, B(tk x tn) with pitch ldb, C(tm x tn) with
+// pitch ldc, pitches in floats and multiples of TILE_N. tk is a multiple
+// of 8, the host zero pads the last panel. A thread calulate a 1 x TILE_N
+// strip of C, the C tile stays on the device while the k panels stream by.
+extern "C"
+#ifndef __INTELLISENSE__
+	_GENX_MAIN_
+#endif
+void
+sgemm_panel(int tk, int lda, int ldb, int ldc,
+	    SurfaceIndex indxA [[type("buffer_t")]],
+	    SurfaceIndex indxB [[type("buffer_t")]],
+	    SurfaceIndex indxC [[type("buffer_t")]])
+{
+	uint32_t col = (cm_group_id(0) * cm_local_size(0) + cm_local_id(0)) * TILE_N;
+	uint32_t row = cm_group_id(1) * cm_local_size(1) + cm_local_id(1);
+	vector<float, TILE_N> acc = 0.0f;
+
+	for (int kk = 0; kk < tk; kk += 8) {
+		vector<float, 8> a;
+		matrix<float, 8, TILE_N> b;
+
+		read(indxA, (row * lda + kk) * sizeof(float), a);
+#pragma unroll
+		for (int t = 0; t < 8; t++)
+			read(indxB, ((kk + t) * ldb + col) * sizeof(float), b.row(t));
+
+#pragma unroll
+		for (int t = 0; t < 8; t++)
+			acc += a(t) * b.row(t);
+	}
+
+	uint32_t offset = (row * ldc + col) * sizeof(float);
+	vector<float, TILE_N> c;
+	read(indxC, offset, c);
+	c += acc;
+	write(indxC, offset, c);
+}